@@ -0,0 +1,860 @@
+#define _GNU_SOURCE
+/* The counting replacements of poll() and others can't be inline functions */
+#undef _FORTIFY_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include <wayland-server.h>
+#include "xdg-shell-server.h"
+#include "wwl.h"
+
+/**
+ * ==================================
+ * Instrumentation Section
+ * ==================================
+ */
+
+/* Only the calls of the thread, which runs the window, are counted */
+static __thread int counting;
+static uint64_t allocations;
+static uint64_t syscalls;
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+    allocations += counting;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocations += counting;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    allocations += counting;
+    return __libc_realloc(ptr, size);
+}
+
+/**
+ * The system calls, which the library and libwayland-client use per frame, are
+ * replaced by counting versions, which call the kernel directly
+ */
+ssize_t sendmsg(int fd, const struct msghdr* msg, int flags) {
+    syscalls += counting;
+    return syscall(SYS_sendmsg, fd, msg, flags);
+}
+
+ssize_t recvmsg(int fd, struct msghdr* msg, int flags) {
+    syscalls += counting;
+    return syscall(SYS_recvmsg, fd, msg, flags);
+}
+
+int poll(struct pollfd* fds, nfds_t nfds, int timeout) {
+    syscalls += counting;
+    struct timespec ts = { timeout / 1000, (timeout % 1000) * 1000000L };
+    return syscall(SYS_ppoll, fds, nfds, timeout < 0 ? NULL : &ts, NULL, 0);
+}
+
+void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    syscalls += counting;
+    return (void*)syscall(SYS_mmap, addr, length, prot, flags, fd, offset);
+}
+
+void* mremap(void* old_address, size_t old_size, size_t new_size, int flags, ...) {
+    syscalls += counting;
+    void* new_address = NULL;
+    if(flags & MREMAP_FIXED) {
+        va_list args;
+        va_start(args, flags);
+        new_address = va_arg(args, void*);
+        va_end(args);
+    }
+    return (void*)syscall(SYS_mremap, old_address, old_size, new_size, flags, new_address);
+}
+
+int munmap(void* addr, size_t length) {
+    syscalls += counting;
+    return syscall(SYS_munmap, addr, length);
+}
+
+int madvise(void* addr, size_t length, int advice) {
+    syscalls += counting;
+    return syscall(SYS_madvise, addr, length, advice);
+}
+
+int mlock(const void* addr, size_t length) {
+    syscalls += counting;
+    return syscall(SYS_mlock, addr, length);
+}
+
+int ftruncate(int fd, off_t length) {
+    syscalls += counting;
+    return syscall(SYS_ftruncate, fd, length);
+}
+
+int memfd_create(const char* name, unsigned int flags) {
+    syscalls += counting;
+    return syscall(SYS_memfd_create, name, flags);
+}
+
+int close(int fd) {
+    syscalls += counting;
+    return syscall(SYS_close, fd);
+}
+
+static uint64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Open a disabled counter of the dTLB misses of the calling thread in user space.
+ * Returns -1, when the CPU or the kernel doesn't provide it, like in most virtual
+ * machines and containers
+ * @op: PERF_COUNT_HW_CACHE_OP_READ or PERF_COUNT_HW_CACHE_OP_WRITE
+ */
+static int open_tlb_counter(int op) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | op << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * Returns the value of a counter and closes it. Returns 0 for counters, which
+ * couldn't be opened
+ */
+static uint64_t read_counter(int fd) {
+    uint64_t value = 0;
+    if(fd < 0) {
+        return 0;
+    }
+    if(read(fd, &value, sizeof(value)) != sizeof(value)) {
+        value = 0;
+    }
+    close(fd);
+    return value;
+}
+
+/**
+ * ==================================
+ * Workload Section
+ * ==================================
+ */
+
+enum workload_type {
+    /* The whole content changes every frame */
+    WORKLOAD_FULL,
+    /* Small regions of the content change every frame */
+    WORKLOAD_REGIONS,
+    /* The compositor sends several new sizes per frame */
+    WORKLOAD_RESIZE,
+    /* The compositor sends hundreds of pointer events per frame */
+    WORKLOAD_INPUT
+};
+
+struct workload {
+    const char* name;
+    enum workload_type type;
+    int width;
+    int height;
+    int frames;
+    /* The wwlMemoryFlags of the window */
+    uint32_t memory;
+};
+
+static const struct workload workloads[] = {
+    { "full-1080p", WORKLOAD_FULL, 1920, 1080, 600, WWL_MEMORY_PREFAULT },
+    { "full-4k", WORKLOAD_FULL, 3840, 2160, 200, WWL_MEMORY_PREFAULT },
+    /* The pages of the buffers are faulted in by the first frames */
+    { "4k-lazy", WORKLOAD_FULL, 3840, 2160, 100, 0 },
+    { "4k-huge", WORKLOAD_FULL, 3840, 2160, 100, WWL_MEMORY_PREFAULT | WWL_MEMORY_HUGE_PAGES },
+    { "regions", WORKLOAD_REGIONS, 1920, 1080, 2000, WWL_MEMORY_PREFAULT },
+    { "resize", WORKLOAD_RESIZE, 1280, 720, 300, WWL_MEMORY_PREFAULT },
+    { "input", WORKLOAD_INPUT, 1920, 1080, 600, WWL_MEMORY_PREFAULT }
+};
+
+#define WORKLOAD_COUNT (sizeof(workloads) / sizeof(workloads[0]))
+
+/* Number of damaged regions per frame of the regions workload */
+#define REGION_COUNT 16
+#define REGION_SIZE 64
+
+/* Number of configure events per frame of the resize workload */
+#define CONFIGURES_PER_FRAME 4
+
+/* Number of pointer events per frame of the input workload */
+#define EVENTS_PER_FRAME 256
+
+/**
+ * ==================================
+ * Server Section
+ * ==================================
+ */
+
+/**
+ * A stand-in for a compositor, which runs in its own thread. It releases the
+ * previous buffer and sends the frame callbacks right after each commit, so the
+ * frame rate is only limited by the library. It doesn't read the buffers
+ */
+static struct {
+    struct wl_display* display;
+    pthread_t thread;
+    atomic_int running;
+    const struct workload* workload;
+    struct wl_list surfaces;
+    struct wl_resource* pointer;
+    int entered;
+    uint32_t frame;
+
+    /* The time, when the last batch of input events has been sent */
+    _Atomic uint64_t input_sent;
+    /* The damaged bytes of all commits, which are read during the run */
+    _Atomic uint64_t damage_bytes;
+    /* Read after the thread has stopped */
+    uint64_t commits;
+    uint64_t configures;
+} server;
+
+struct server_buffer {
+    int width;
+    int height;
+};
+
+struct server_surface {
+    struct wl_list link;
+    struct wl_resource* resource;
+    struct wl_resource* pending_buffer;
+    struct wl_resource* buffer;
+    int attached;
+    uint64_t pending_damage;
+    struct wl_list frames;
+    struct wl_resource* xdg_surface;
+    struct wl_resource* toplevel;
+};
+
+static void destroy_resource(struct wl_client* client, struct wl_resource* resource) {
+    wl_resource_destroy(resource);
+}
+
+static void buffer_destroyed(struct wl_resource* resource) {
+    struct server_surface* surface;
+    wl_list_for_each(surface, &server.surfaces, link) {
+        if(surface->buffer == resource) {
+            surface->buffer = NULL;
+        }
+        if(surface->pending_buffer == resource) {
+            surface->pending_buffer = NULL;
+        }
+    }
+    free(wl_resource_get_user_data(resource));
+}
+
+static const struct wl_buffer_interface buffer_implementation = {
+    .destroy = destroy_resource
+};
+
+static void pool_create_buffer(struct wl_client* client, struct wl_resource* resource, uint32_t id, int32_t offset, int32_t width, int32_t height, int32_t stride, uint32_t format) {
+    struct server_buffer* buffer = calloc(1, sizeof(struct server_buffer));
+    buffer->width = width;
+    buffer->height = height;
+    struct wl_resource* buffer_resource = wl_resource_create(client, &wl_buffer_interface, 1, id);
+    wl_resource_set_implementation(buffer_resource, &buffer_implementation, buffer, buffer_destroyed);
+}
+
+static void pool_resize(struct wl_client* client, struct wl_resource* resource, int32_t size) {
+
+}
+
+static const struct wl_shm_pool_interface pool_implementation = {
+    .create_buffer = pool_create_buffer,
+    .destroy = destroy_resource,
+    .resize = pool_resize
+};
+
+static void shm_create_pool(struct wl_client* client, struct wl_resource* resource, uint32_t id, int32_t fd, int32_t size) {
+    /* The pixels are never read, so the file isn't mapped */
+    close(fd);
+    struct wl_resource* pool = wl_resource_create(client, &wl_shm_pool_interface, 1, id);
+    wl_resource_set_implementation(pool, &pool_implementation, NULL, NULL);
+}
+
+static const struct wl_shm_interface shm_implementation = {
+    .create_pool = shm_create_pool
+};
+
+static void bind_shm(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+    struct wl_resource* resource = wl_resource_create(client, &wl_shm_interface, 1, id);
+    wl_resource_set_implementation(resource, &shm_implementation, NULL, NULL);
+    wl_shm_send_format(resource, WL_SHM_FORMAT_ARGB8888);
+    wl_shm_send_format(resource, WL_SHM_FORMAT_XRGB8888);
+}
+
+static void send_configure(struct server_surface* surface, int width, int height) {
+    struct wl_array states;
+    wl_array_init(&states);
+    xdg_toplevel_send_configure(surface->toplevel, width, height, &states);
+    wl_array_release(&states);
+    xdg_surface_send_configure(surface->xdg_surface, wl_display_next_serial(server.display));
+    server.configures++;
+}
+
+/**
+ * Run the part of the workload, which the compositor does after each commit
+ * @surface: The committed surface
+ */
+static void workload_step(struct server_surface* surface) {
+    if(server.workload->type == WORKLOAD_RESIZE && surface->toplevel != NULL) {
+        /* Sizes between 640x360 and 3840x2160, like a window dragged across a
+        4K screen */
+        for(int i = 0; i < CONFIGURES_PER_FRAME; i++) {
+            uint32_t step = server.frame * CONFIGURES_PER_FRAME + i;
+            send_configure(surface, 640 + (step * 97) % 3200, 360 + (step * 53) % 1800);
+        }
+    }
+    if(server.workload->type == WORKLOAD_INPUT && server.pointer != NULL) {
+        if(!server.entered) {
+            wl_pointer_send_enter(server.pointer, wl_display_next_serial(server.display), surface->resource, 0, 0);
+            wl_pointer_send_frame(server.pointer);
+            server.entered = 1;
+        }
+        atomic_store(&server.input_sent, now());
+        for(int i = 0; i < EVENTS_PER_FRAME; i++) {
+            uint32_t step = server.frame * EVENTS_PER_FRAME + i;
+            wl_pointer_send_motion(server.pointer, step, wl_fixed_from_int(step % 1920), wl_fixed_from_int(step % 1080));
+            wl_pointer_send_frame(server.pointer);
+        }
+    }
+}
+
+static void frame_destroyed(struct wl_resource* resource) {
+    wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void surface_attach(struct wl_client* client, struct wl_resource* resource, struct wl_resource* buffer, int32_t x, int32_t y) {
+    struct server_surface* surface = wl_resource_get_user_data(resource);
+    surface->pending_buffer = buffer;
+    surface->attached = 1;
+}
+
+/**
+ * Count the damaged bytes of a rectangle, which is clipped to the attached buffer
+ */
+static void add_damage(struct server_surface* surface, int32_t width, int32_t height) {
+    struct wl_resource* resource = surface->attached ? surface->pending_buffer : surface->buffer;
+    if(resource != NULL) {
+        struct server_buffer* buffer = wl_resource_get_user_data(resource);
+        width = width < buffer->width ? width : buffer->width;
+        height = height < buffer->height ? height : buffer->height;
+    }
+    surface->pending_damage += (uint64_t)width * height * 4;
+}
+
+static void surface_damage(struct wl_client* client, struct wl_resource* resource, int32_t x, int32_t y, int32_t width, int32_t height) {
+    add_damage(wl_resource_get_user_data(resource), width, height);
+}
+
+static void surface_frame(struct wl_client* client, struct wl_resource* resource, uint32_t id) {
+    struct server_surface* surface = wl_resource_get_user_data(resource);
+    struct wl_resource* callback = wl_resource_create(client, &wl_callback_interface, 1, id);
+    wl_resource_set_implementation(callback, NULL, NULL, frame_destroyed);
+    wl_list_insert(surface->frames.prev, wl_resource_get_link(callback));
+}
+
+static void surface_set_region(struct wl_client* client, struct wl_resource* resource, struct wl_resource* region) {
+
+}
+
+static void surface_commit(struct wl_client* client, struct wl_resource* resource) {
+    struct server_surface* surface = wl_resource_get_user_data(resource);
+    if(surface->attached) {
+        if(surface->buffer != NULL && surface->buffer != surface->pending_buffer) {
+            wl_buffer_send_release(surface->buffer);
+        }
+        surface->buffer = surface->pending_buffer;
+        surface->attached = 0;
+    }
+    atomic_fetch_add(&server.damage_bytes, surface->pending_damage);
+    surface->pending_damage = 0;
+    if(surface->buffer == NULL) {
+        return;
+    }
+    server.commits++;
+
+    workload_step(surface);
+    server.frame++;
+
+    uint32_t time = now() / 1000000;
+    struct wl_resource* callback;
+    struct wl_resource* tmp;
+    wl_resource_for_each_safe(callback, tmp, &surface->frames) {
+        wl_callback_send_done(callback, time);
+        wl_resource_destroy(callback);
+    }
+}
+
+static void surface_set_int(struct wl_client* client, struct wl_resource* resource, int32_t value) {
+
+}
+
+static const struct wl_surface_interface surface_implementation = {
+    .destroy = destroy_resource,
+    .attach = surface_attach,
+    .damage = surface_damage,
+    .frame = surface_frame,
+    .set_opaque_region = surface_set_region,
+    .set_input_region = surface_set_region,
+    .commit = surface_commit,
+    .set_buffer_transform = surface_set_int,
+    .set_buffer_scale = surface_set_int,
+    .damage_buffer = surface_damage
+};
+
+static void surface_destroyed(struct wl_resource* resource) {
+    struct server_surface* surface = wl_resource_get_user_data(resource);
+    struct wl_resource* callback;
+    struct wl_resource* tmp;
+    wl_resource_for_each_safe(callback, tmp, &surface->frames) {
+        wl_resource_destroy(callback);
+    }
+    /* A disconnecting client destroys the surface before its roles */
+    if(surface->xdg_surface != NULL) {
+        wl_resource_set_user_data(surface->xdg_surface, NULL);
+    }
+    if(surface->toplevel != NULL) {
+        wl_resource_set_user_data(surface->toplevel, NULL);
+    }
+    wl_list_remove(&surface->link);
+    free(surface);
+}
+
+static void region_rect(struct wl_client* client, struct wl_resource* resource, int32_t x, int32_t y, int32_t width, int32_t height) {
+
+}
+
+static const struct wl_region_interface region_implementation = {
+    .destroy = destroy_resource,
+    .add = region_rect,
+    .subtract = region_rect
+};
+
+static void compositor_create_surface(struct wl_client* client, struct wl_resource* resource, uint32_t id) {
+    struct server_surface* surface = calloc(1, sizeof(struct server_surface));
+    wl_list_init(&surface->frames);
+    surface->resource = wl_resource_create(client, &wl_surface_interface, wl_resource_get_version(resource), id);
+    wl_resource_set_implementation(surface->resource, &surface_implementation, surface, surface_destroyed);
+    wl_list_insert(&server.surfaces, &surface->link);
+}
+
+static void compositor_create_region(struct wl_client* client, struct wl_resource* resource, uint32_t id) {
+    struct wl_resource* region = wl_resource_create(client, &wl_region_interface, 1, id);
+    wl_resource_set_implementation(region, &region_implementation, NULL, NULL);
+}
+
+static const struct wl_compositor_interface compositor_implementation = {
+    .create_surface = compositor_create_surface,
+    .create_region = compositor_create_region
+};
+
+static void bind_compositor(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+    struct wl_resource* resource = wl_resource_create(client, &wl_compositor_interface, version, id);
+    wl_resource_set_implementation(resource, &compositor_implementation, NULL, NULL);
+}
+
+static void toplevel_set_string(struct wl_client* client, struct wl_resource* resource, const char* string) {
+
+}
+
+static const struct xdg_toplevel_interface toplevel_implementation = {
+    .destroy = destroy_resource,
+    .set_title = toplevel_set_string,
+    .set_app_id = toplevel_set_string
+};
+
+static void toplevel_destroyed(struct wl_resource* resource) {
+    struct server_surface* surface = wl_resource_get_user_data(resource);
+    if(surface != NULL) {
+        surface->toplevel = NULL;
+    }
+}
+
+static void xdg_surface_handle_get_toplevel(struct wl_client* client, struct wl_resource* resource, uint32_t id) {
+    struct server_surface* surface = wl_resource_get_user_data(resource);
+    surface->toplevel = wl_resource_create(client, &xdg_toplevel_interface, 1, id);
+    wl_resource_set_implementation(surface->toplevel, &toplevel_implementation, surface, toplevel_destroyed);
+    /* Let the client choose its size */
+    send_configure(surface, 0, 0);
+}
+
+static void xdg_surface_handle_ack_configure(struct wl_client* client, struct wl_resource* resource, uint32_t serial) {
+
+}
+
+static const struct xdg_surface_interface xdg_surface_implementation = {
+    .destroy = destroy_resource,
+    .get_toplevel = xdg_surface_handle_get_toplevel,
+    .ack_configure = xdg_surface_handle_ack_configure
+};
+
+static void xdg_surface_destroyed(struct wl_resource* resource) {
+    struct server_surface* surface = wl_resource_get_user_data(resource);
+    if(surface != NULL) {
+        surface->xdg_surface = NULL;
+    }
+}
+
+static void wm_base_get_xdg_surface(struct wl_client* client, struct wl_resource* resource, uint32_t id, struct wl_resource* surface_resource) {
+    struct server_surface* surface = wl_resource_get_user_data(surface_resource);
+    surface->xdg_surface = wl_resource_create(client, &xdg_surface_interface, 1, id);
+    wl_resource_set_implementation(surface->xdg_surface, &xdg_surface_implementation, surface, xdg_surface_destroyed);
+}
+
+static void wm_base_pong(struct wl_client* client, struct wl_resource* resource, uint32_t serial) {
+
+}
+
+static const struct xdg_wm_base_interface wm_base_implementation = {
+    .destroy = destroy_resource,
+    .get_xdg_surface = wm_base_get_xdg_surface,
+    .pong = wm_base_pong
+};
+
+static void bind_wm_base(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+    struct wl_resource* resource = wl_resource_create(client, &xdg_wm_base_interface, 1, id);
+    wl_resource_set_implementation(resource, &wm_base_implementation, NULL, NULL);
+}
+
+static void pointer_set_cursor(struct wl_client* client, struct wl_resource* resource, uint32_t serial, struct wl_resource* surface, int32_t x, int32_t y) {
+
+}
+
+static const struct wl_pointer_interface pointer_implementation = {
+    .set_cursor = pointer_set_cursor,
+    .release = destroy_resource
+};
+
+static void pointer_destroyed(struct wl_resource* resource) {
+    server.pointer = NULL;
+}
+
+static void seat_get_pointer(struct wl_client* client, struct wl_resource* resource, uint32_t id) {
+    server.pointer = wl_resource_create(client, &wl_pointer_interface, wl_resource_get_version(resource), id);
+    wl_resource_set_implementation(server.pointer, &pointer_implementation, NULL, pointer_destroyed);
+}
+
+static const struct wl_seat_interface seat_implementation = {
+    .get_pointer = seat_get_pointer,
+    .release = destroy_resource
+};
+
+static void bind_seat(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+    struct wl_resource* resource = wl_resource_create(client, &wl_seat_interface, version, id);
+    wl_resource_set_implementation(resource, &seat_implementation, NULL, NULL);
+    wl_seat_send_capabilities(resource, WL_SEAT_CAPABILITY_POINTER);
+}
+
+static void* server_thread(void* data) {
+    struct wl_event_loop* loop = wl_display_get_event_loop(server.display);
+    while(atomic_load(&server.running)) {
+        wl_event_loop_dispatch(loop, 10);
+        wl_display_flush_clients(server.display);
+    }
+    return NULL;
+}
+
+/**
+ * Start the stand-in compositor and let the next window connect to it
+ * @workload: The workload, which the compositor takes part in
+ */
+static int start_server(const struct workload* workload) {
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        fprintf(stderr, "Couldn't create the socket pair\n");
+        return -1;
+    }
+
+    memset(&server, 0, sizeof(server));
+    server.workload = workload;
+    wl_list_init(&server.surfaces);
+    server.display = wl_display_create();
+    wl_global_create(server.display, &wl_compositor_interface, 4, NULL, bind_compositor);
+    wl_global_create(server.display, &wl_shm_interface, 1, NULL, bind_shm);
+    wl_global_create(server.display, &xdg_wm_base_interface, 1, NULL, bind_wm_base);
+    wl_global_create(server.display, &wl_seat_interface, 5, NULL, bind_seat);
+    wl_client_create(server.display, fds[0]);
+
+    /* wl_display_connect() takes over the connected socket */
+    char fd[16];
+    snprintf(fd, sizeof(fd), "%d", fds[1]);
+    setenv("WAYLAND_SOCKET", fd, 1);
+
+    atomic_store(&server.running, 1);
+    pthread_create(&server.thread, NULL, server_thread, NULL);
+    return 0;
+}
+
+static void stop_server(void) {
+    atomic_store(&server.running, 0);
+    pthread_join(server.thread, NULL);
+    wl_display_destroy_clients(server.display);
+    wl_display_destroy(server.display);
+}
+
+/**
+ * ==================================
+ * Client Section
+ * ==================================
+ */
+
+static int frame_done;
+static uint64_t input_seen;
+static uint64_t* input_latencies;
+static int input_count;
+
+static void on_frame(wwlWindow* window, uint32_t time) {
+    frame_done = 1;
+}
+
+static void on_cursor(wwlWindow* window, double x, double y) {
+    /* The latency of the first event of each batch */
+    uint64_t sent = atomic_load(&server.input_sent);
+    if(sent != input_seen && input_count < EVENTS_PER_FRAME * 4096) {
+        input_latencies[input_count++] = now() - sent;
+        input_seen = sent;
+    }
+}
+
+static int compare(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Returns the percentile of sorted values in milliseconds
+ */
+static double percentile(const uint64_t* values, int count, int percent) {
+    if(count == 0) {
+        return 0;
+    }
+    return values[(count - 1) * percent / 100] / 1e6;
+}
+
+static void print_header(void) {
+    printf("%-11s %9s %9s %9s %9s %9s %9s %9s %8s %8s %8s %8s\n", "workload", "frames/s", "dmg KiB", "copy KiB", "syscalls", "allocs", "faults", "dTLB", "p50 ms", "p90 ms", "p99 ms", "max ms");
+}
+
+/**
+ * Run one workload against the connected compositor and print a line with its
+ * results
+ * @workload: The workload
+ * @live: True, when a real compositor is used instead of the stand-in
+ */
+static int run(const struct workload* workload, int live) {
+    if(!live && start_server(workload) < 0) {
+        return -1;
+    }
+    wwlWindow* window = wwlCreateWindow(workload->width, workload->height, "Benchmark");
+    if(window == NULL) {
+        if(!live) {
+            stop_server();
+        }
+        return -1;
+    }
+    wwlSetFrameCallback(window, on_frame);
+    wwlSetCursorCallback(window, on_cursor);
+    wwlSetMemoryFlags(window, workload->memory);
+    wwlSetInputTracing(window, workload->type == WORKLOAD_INPUT);
+
+    int width, height;
+    wwlGetDimensions(window, &width, &height);
+    int capacity = width * height;
+    uint32_t* content = malloc(capacity * sizeof(uint32_t));
+    memset(content, 0, capacity * sizeof(uint32_t));
+    /* The first frame allocates the buffers */
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    uint64_t setup_start = now();
+    wwlDraw(window, content, width * height * sizeof(uint32_t));
+    /* Let the window settle, before measuring */
+    for(int i = 0; i < 10; i++) {
+        wwlWaitEventsTimeout(window, 10);
+    }
+    double setup_time = (now() - setup_start) / 1e6;
+    getrusage(RUSAGE_SELF, &after);
+    long setup_faults = after.ru_minflt - before.ru_minflt + after.ru_majflt - before.ru_majflt;
+
+    uint64_t* frame_times = calloc(workload->frames, sizeof(uint64_t));
+    input_latencies = calloc(EVENTS_PER_FRAME * 4096, sizeof(uint64_t));
+    input_count = 0;
+    input_seen = 0;
+    uint64_t damage_before = atomic_load(&server.damage_bytes);
+    wwlStats counters_before;
+    wwlGetStats(window, &counters_before);
+
+    int tlb_reads = open_tlb_counter(PERF_COUNT_HW_CACHE_OP_READ);
+    int tlb_writes = open_tlb_counter(PERF_COUNT_HW_CACHE_OP_WRITE);
+    if(tlb_reads >= 0 && tlb_writes >= 0) {
+        ioctl(tlb_reads, PERF_EVENT_IOC_ENABLE, 0);
+        ioctl(tlb_writes, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    getrusage(RUSAGE_SELF, &before);
+    allocations = 0;
+    syscalls = 0;
+    counting = 1;
+    uint64_t start = now();
+
+    int frames = 0;
+    for(; frames < workload->frames; frames++) {
+        uint64_t frame_start = now();
+        int newWidth, newHeight;
+        wwlGetDimensions(window, &newWidth, &newHeight);
+        if(newWidth != width || newHeight != height) {
+            width = newWidth;
+            height = newHeight;
+            if(width * height > capacity) {
+                capacity = width * height;
+                content = realloc(content, capacity * sizeof(uint32_t));
+            }
+        }
+
+        if(workload->type == WORKLOAD_REGIONS || workload->type == WORKLOAD_INPUT) {
+            wwlRect rects[REGION_COUNT];
+            for(int i = 0; i < REGION_COUNT; i++) {
+                rects[i] = (wwlRect){ (frames * 131 + i * 257) % (width - REGION_SIZE), (frames * 71 + i * 113) % (height - REGION_SIZE), REGION_SIZE, REGION_SIZE };
+                for(int y = rects[i].y; y < rects[i].y + REGION_SIZE; y++) {
+                    for(int x = rects[i].x; x < rects[i].x + REGION_SIZE; x++) {
+                        content[y * width + x] = 0xFF000000 | (frames * 4 + i);
+                    }
+                }
+            }
+            wwlDrawRegions(window, content, rects, REGION_COUNT);
+        } else {
+            for(int i = 0; i < width * height; i++) {
+                /* Not a single color, which would be shown with a single pixel */
+                content[i] = 0xFF000000 | ((frames * 4 + i) & 0xFFFFFF);
+            }
+            wwlDraw(window, content, width * height * sizeof(uint32_t));
+        }
+
+        frame_done = 0;
+        while(!frame_done) {
+            if(wwlWaitEventsTimeout(window, 1000)) {
+                break;
+            }
+        }
+        frame_times[frames] = now() - frame_start;
+        if(!frame_done) {
+            fprintf(stderr, "%s: no frame callback\n", workload->name);
+            break;
+        }
+    }
+
+    double elapsed = (now() - start) / 1e9;
+    counting = 0;
+    getrusage(RUSAGE_SELF, &after);
+    char tlb[16] = "-";
+    uint64_t tlb_misses = read_counter(tlb_reads) + read_counter(tlb_writes);
+    if(tlb_reads >= 0 && tlb_writes >= 0 && frames > 0) {
+        snprintf(tlb, sizeof(tlb), "%.1f", (double)tlb_misses / frames);
+    }
+    wwlFrameStats stats;
+    wwlGetFrameStats(window, &stats);
+    wwlStats counters;
+    wwlGetStats(window, &counters);
+    wwlInputLatency latency;
+    wwlGetInputLatency(window, &latency);
+
+    free(content);
+    wwlCloseWindow(window);
+    if(!live) {
+        stop_server();
+    }
+    if(frames == 0) {
+        free(frame_times);
+        free(input_latencies);
+        return -1;
+    }
+
+    qsort(frame_times, frames, sizeof(uint64_t), compare);
+    char damage[16] = "-";
+    if(!live) {
+        snprintf(damage, sizeof(damage), "%.1f", (atomic_load(&server.damage_bytes) - damage_before) / 1024.0 / frames);
+    }
+    printf("%-11s %9.1f %9s %9.1f %9.1f %9.1f %9.1f %9s %8.3f %8.3f %8.3f %8.3f\n", workload->name, frames / elapsed, damage,
+            (counters.bytes_uploaded - counters_before.bytes_uploaded) / 1024.0 / frames, (double)syscalls / frames, (double)allocations / frames,
+            (double)(after.ru_minflt - before.ru_minflt + after.ru_majflt - before.ru_majflt) / frames, tlb,
+            percentile(frame_times, frames, 50), percentile(frame_times, frames, 90), percentile(frame_times, frames, 99), percentile(frame_times, frames, 100));
+    if(workload->type == WORKLOAD_INPUT && input_count > 0) {
+        qsort(input_latencies, input_count, sizeof(uint64_t), compare);
+        printf("%-11s %d batches of %d events, latency p50 %.3fms, p99 %.3fms, max %.3fms\n", "", input_count, EVENTS_PER_FRAME,
+                percentile(input_latencies, input_count, 50), percentile(input_latencies, input_count, 99), percentile(input_latencies, input_count, 100));
+    }
+    if(latency.committed > 0) {
+        printf("%-11s input to commit %.3fms", "", latency.total_to_commit / 1e6 / latency.committed);
+        if(latency.presented > 0) {
+            printf(", to present %.3fms, max %.3fms", latency.total_to_present / 1e6 / latency.presented, latency.max_to_present / 1e6);
+        }
+        printf(" for %" PRIu64 " frames\n", latency.committed);
+    }
+    if(stats.presented > 0) {
+        printf("%-11s presented: %" PRIu64 ", dropped: %" PRIu64 ", late: %" PRIu64 ", refresh: %.2fms\n", "", stats.presented, stats.dropped, stats.late, stats.refresh / 1e6);
+    }
+    printf("%-11s dispatch %.3fms, callbacks %.3fms, skipped %" PRIu64 ", shm allocations %" PRIu64 " per %d frames\n", "",
+            (counters.dispatch_time - counters_before.dispatch_time) / 1e6 / frames, (counters.callback_time - counters_before.callback_time) / 1e6 / frames,
+            counters.skipped - counters_before.skipped, counters.shm_allocations - counters_before.shm_allocations, frames);
+    printf("%-11s first frame %.3fms with %ld page faults\n", "", setup_time, setup_faults);
+    if(workload->type == WORKLOAD_RESIZE && !live) {
+        printf("%-11s %" PRIu64 " configures for %d frames\n", "", server.configures, frames);
+    }
+
+    free(frame_times);
+    free(input_latencies);
+    return 0;
+}
+
+int main(int argc, char const *argv[]) {
+    int live = 0;
+    int selected = 0;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--live") == 0) {
+            live = 1;
+        } else {
+            selected++;
+        }
+    }
+
+    print_header();
+    for(unsigned int i = 0; i < WORKLOAD_COUNT; i++) {
+        int run_it = selected == 0;
+        for(int j = 1; j < argc; j++) {
+            run_it |= strcmp(argv[j], workloads[i].name) == 0;
+        }
+        if(run_it && run(&workloads[i], live) < 0) {
+            fprintf(stderr, "%s failed\n", workloads[i].name);
+            return 1;
+        }
+    }
+    return 0;
+}
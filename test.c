@@ -1,11 +1,11 @@
 #include <stdlib.h>
 #include <stdio.h>
-#include <string.h>
+#include <xkbcommon/xkbcommon-keysyms.h>
 #include "wwl.h"
 
-void key_callback(wwlWindow* window, char* key, enum wwlKeyAction action) {
-    /* The keys a modifier sensitive. This means Shift_L and a have been pressed */
-    if(strcmp(key, "A") == 0 && action == WWL_KEY_PRESSED) {
+void key_callback(wwlWindow* window, uint32_t keycode, uint32_t keysym, uint32_t modifiers, uint32_t time, enum wwlKeyAction action) {
+    /* The keysyms are modifier sensitive. This means Shift_L and a have been pressed */
+    if(keysym == XKB_KEY_A && action == WWL_KEY_PRESSED) {
         printf("'A' was pressed\n");
     }
 }
@@ -15,7 +15,7 @@ int main(int argc, char const *argv[]) {
     wwlWindow* window = wwlCreateWindow(800, 600, "Test");
 
     /* Set the key callback function */
-    wwlSetKeyCallback(window, key_callback);
+    wwlSetKeySymCallback(window, key_callback);
 
     /* Get the current size of the window. This is important for tiling WMs like
     sway */
@@ -37,11 +37,12 @@ int main(int argc, char const *argv[]) {
         int newWidth, newHeight;
         wwlGetDimensions(window, &newWidth, &newHeight);
         if(newWidth != width || newHeight != height) {
-            /* Recreate the content with the new size */
+            /* Only grow the content, so a shrinking window reuses it */
+            if(newWidth * newHeight > width * height) {
+                content = realloc(content, newWidth * newHeight * sizeof(uint32_t));
+            }
             width = newWidth;
             height = newHeight;
-            free(content);
-            content = malloc(width * height * sizeof(uint32_t));
             for(int i = 0; i < width * height; i++) {
                 content[i] = 0xFFFFFFFF;
             }
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -5,16 +6,175 @@
 #include <errno.h>
 #include <string.h>
 #include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <sys/mman.h>
+#ifdef WWL_USDT
+#include <sys/sdt.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 #include <xkbcommon/xkbcommon.h>
 #include <wayland-client.h>
 #include "xdg-shell.h"
+#include "presentation-time.h"
+#include "viewporter.h"
+#include "fractional-scale-v1.h"
+#include "single-pixel-buffer-v1.h"
+#include "relative-pointer-unstable-v1.h"
+#include "input-timestamps-unstable-v1.h"
+
+typedef struct wwlRect {
+    int x;
+    int y;
+    int width;
+    int height;
+} wwlRect;
+
+typedef struct wwlDiffStats {
+    uint64_t time;
+    int tiles;
+    int dirty_tiles;
+    int rects;
+} wwlDiffStats;
+
+#define WWL_LATENCY_BUCKETS 32
+
+typedef struct wwlFrameStats {
+    uint64_t presented;
+    uint64_t dropped;
+    uint64_t late;
+    uint64_t latency;
+    uint64_t refresh;
+    uint32_t histogram[WWL_LATENCY_BUCKETS];
+} wwlFrameStats;
+
+typedef struct wwlStats {
+    uint64_t frames;
+    uint64_t skipped;
+    uint64_t bytes_uploaded;
+    uint64_t shm_allocations;
+    uint64_t dispatch_time;
+    uint64_t callback_time;
+} wwlStats;
+
+enum wwlPixelFormat {
+    WWL_FORMAT_XRGB8888,
+    WWL_FORMAT_ARGB8888,
+    WWL_FORMAT_XBGR8888,
+    WWL_FORMAT_ABGR8888,
+    WWL_FORMAT_RGBX8888,
+    WWL_FORMAT_RGBA8888,
+    WWL_FORMAT_BGRX8888,
+    WWL_FORMAT_BGRA8888,
+    WWL_FORMAT_RGB565
+};
+
+enum wwlMemoryFlag {
+    WWL_MEMORY_PREFAULT = 1,
+    WWL_MEMORY_HUGE_PAGES = 2,
+    WWL_MEMORY_LOCK = 4
+};
+
+enum wwlWindowState {
+    WWL_STATE_MAXIMIZED = 1 << 0,
+    WWL_STATE_FULLSCREEN = 1 << 1,
+    WWL_STATE_RESIZING = 1 << 2,
+    WWL_STATE_ACTIVATED = 1 << 3,
+    WWL_STATE_TILED_LEFT = 1 << 4,
+    WWL_STATE_TILED_RIGHT = 1 << 5,
+    WWL_STATE_TILED_TOP = 1 << 6,
+    WWL_STATE_TILED_BOTTOM = 1 << 7,
+    WWL_STATE_SUSPENDED = 1 << 8,
+    WWL_STATE_HIDDEN = 1 << 9
+};
+
+enum wwlYUVFormat {
+    WWL_YUV_NV12,
+    WWL_YUV_I420,
+    WWL_YUV_YUYV
+};
 
 enum wwlKeyAction {
     WWL_KEY_PRESSED,
     WWL_KEY_RELEASED
 };
 
+enum wwlModifier {
+    WWL_MOD_SHIFT = 1 << 0,
+    WWL_MOD_CTRL = 1 << 1,
+    WWL_MOD_ALT = 1 << 2,
+    WWL_MOD_SUPER = 1 << 3,
+    WWL_MOD_CAPS_LOCK = 1 << 4,
+    WWL_MOD_NUM_LOCK = 1 << 5
+};
+
+enum wwlEventType {
+    WWL_EVENT_KEY,
+    WWL_EVENT_MOTION,
+    WWL_EVENT_BUTTON,
+    WWL_EVENT_SCROLL,
+    WWL_EVENT_RELATIVE_MOTION
+};
+
+enum wwlCoalesce {
+    WWL_COALESCE_MOTION = 1 << 0,
+    WWL_COALESCE_SCROLL = 1 << 1,
+    WWL_COALESCE_RELATIVE = 1 << 2
+};
+
+typedef struct wwlEvent {
+    enum wwlEventType type;
+    uint32_t time;
+    uint64_t timestamp;
+    union {
+        struct {
+            uint32_t keycode;
+            uint32_t keysym;
+            uint32_t modifiers;
+            enum wwlKeyAction action;
+        } key;
+        struct {
+            double x;
+            double y;
+        } motion;
+        struct {
+            int button;
+            enum wwlKeyAction action;
+        } button;
+        struct {
+            double x_offset;
+            double y_offset;
+        } scroll;
+        struct {
+            double dx;
+            double dy;
+            double dx_unaccel;
+            double dy_unaccel;
+        } relative;
+    };
+} wwlEvent;
+
+typedef struct wwlEventStats {
+    uint64_t queued;
+    uint64_t dropped;
+    uint64_t coalesced;
+} wwlEventStats;
+
+typedef struct wwlInputLatency {
+    uint64_t committed;
+    uint64_t presented;
+    uint64_t to_commit;
+    uint64_t to_present;
+    uint64_t max_to_present;
+    uint64_t total_to_commit;
+    uint64_t total_to_present;
+} wwlInputLatency;
+
 enum pointer_event_mask {
        POINTER_EVENT_ENTER = 1 << 0,
        POINTER_EVENT_LEAVE = 1 << 1,
@@ -24,6 +184,7 @@ enum pointer_event_mask {
        POINTER_EVENT_AXIS_SOURCE = 1 << 5,
        POINTER_EVENT_AXIS_STOP = 1 << 6,
        POINTER_EVENT_AXIS_DISCRETE = 1 << 7,
+       POINTER_EVENT_RELATIVE = 1 << 8,
 };
 
 struct pointer_event {
@@ -31,7 +192,11 @@ struct pointer_event {
        wl_fixed_t surface_x, surface_y;
        uint32_t button, state;
        uint32_t time;
+       /* The timestamp from zwp_input_timestamps_v1 in nanoseconds. 0, when
+       there is none */
+       uint64_t timestamp;
        uint32_t serial;
+       wl_fixed_t dx, dy, dx_unaccel, dy_unaccel;
        struct {
                int valid;
                wl_fixed_t value;
@@ -40,37 +205,524 @@ struct pointer_event {
        uint32_t axis_source;
 };
 
-typedef struct wwlWindow {
+/**
+ * Number of buffers in the swapchain. Three buffers allow one buffer to be
+ * shown, one to be queued in the compositor and one to be drawn into
+ */
+#define WWL_BUFFER_COUNT 3
+
+/**
+ * Maximum number of damage rectangles, which are tracked per frame. When more
+ * regions get damaged, they are merged into their bounding box
+ */
+#define WWL_MAX_DAMAGE 16
+
+/**
+ * Size of the tiles in pixels, which are compared, when the damage is detected
+ * automatically
+ */
+#define WWL_TILE_SIZE 64
+
+/**
+ * Maximum number of frames, whose presentation feedback is pending at the same
+ * time
+ */
+#define WWL_FEEDBACK_COUNT 8
+
+/**
+ * Number of frames, which are part of the latency histogram
+ */
+#define WWL_LATENCY_HISTORY 128
+
+/**
+ * Flag in the configure mailbox, which marks a configuration, that hasn't been
+ * taken by the render thread yet
+ */
+#define WWL_MAILBOX_NEW 4
+
+/**
+ * Time in nanoseconds, after which a configuration gets applied, even when the
+ * frame callback hasn't arrived yet. Hidden windows don't get frame callbacks
+ */
+#define WWL_CONFIGURE_TIMEOUT 100000000
+
+/**
+ * Time in nanoseconds, after which a window without a frame callback for its
+ * last frame counts as hidden. Compositors, which still send a few frame
+ * callbacks to hidden windows, send them less often than this
+ */
+#define WWL_HIDDEN_TIMEOUT 500000000
+
+/**
+ * Default minimum time in milliseconds between two calls of
+ * wwlPollEventsThrottled(), while the window is hidden or suspended
+ */
+#define WWL_HIDDEN_INTERVAL 100
+
+/**
+ * Highest version of xdg_wm_base, whose events are handled. Version 6 adds the
+ * suspended state
+ */
+#define WWL_WM_BASE_VERSION 6
+
+/**
+ * Highest version of wl_seat, whose events are handled. Version 8 replaces
+ * axis_discrete with axis_value120, which the pointer listener doesn't have
+ */
+#define WWL_SEAT_VERSION 7
+
+/**
+ * Number of keysyms, which are tracked by the key-down bitmap. The first 256
+ * slots are the Latin-1 keysyms, the next 256 slots are the function keys from
+ * 0xff00 to 0xffff
+ */
+#define WWL_KEY_BITS 512
+
+/**
+ * Maximum number of outputs, which are tracked per surface. The buffer scale
+ * follows the highest scale of these outputs
+ */
+#define WWL_MAX_OUTPUTS 8
+
+/**
+ * Denominator of the fractional scale. A scale of 120 is a scale of 1
+ */
+#define WWL_SCALE_BASE 120
+
+/**
+ * Size of the pool for the single pixel buffers of solid frames, when the
+ * compositor doesn't support wp_single_pixel_buffer_manager_v1. Every color gets
+ * the next pixel of the pool
+ */
+#define WWL_SOLID_POOL_SIZE 4096
+
+/**
+ * Size of a transparent huge page. Pools with huge pages are a multiple of it, so
+ * their last part doesn't fall back to normal pages
+ */
+#define WWL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/**
+ * Number of pixels of a row, which are converted from YUV at once. The chroma of
+ * NV12 and YUYV is split into planes in chunks of this size first
+ */
+#define WWL_YUV_CHUNK 512
+
+/**
+ * Video frames with fewer pixels are converted by the calling thread alone,
+ * because waking up the workers would cost more than it saves
+ */
+#define WWL_PARALLEL_PIXELS (640 * 360)
+
+/**
+ * Maximum number of worker threads, which convert video frames together with
+ * the calling thread
+ */
+#define WWL_MAX_WORKERS 7
+
+struct wwlWindow;
+struct wwlContext;
+
+/* The counters of wwlStats, which the render thread writes, while other threads
+read them */
+struct wwlCounters {
+    atomic_uint_least64_t frames;
+    atomic_uint_least64_t skipped;
+    atomic_uint_least64_t bytes_uploaded;
+    atomic_uint_least64_t shm_allocations;
+};
+
+struct wwlConfigure {
+    uint32_t serial;
+    int width;
+    int height;
+};
+
+struct wwlFeedback {
+    struct wwlWindow* window;
+    struct wp_presentation_feedback* feedback;
+    /* The time of the commit in the clock of the presentation */
+    uint64_t submitted;
+    /* The time of the commit and of the traced input event, which the frame
+    reflects, in nanoseconds of CLOCK_MONOTONIC. input is 0, when there is none */
+    uint64_t committed;
+    uint64_t input;
+    uint64_t input_id;
+};
+
+struct wwlBuffer {
+    struct wwlWindow* window;
+    struct wl_buffer* buffer;
+    int offset;
+    int width;
+    int height;
+    int stride;
+    /* The number of bytes of all planes */
+    int size;
+    uint32_t format;
+    /* The buffer is held by the compositor until it sends the release event */
+    int busy;
+    /* Number of frames since the content of this buffer has been presented. 0
+    means, that the content is undefined */
+    int age;
+    /* Regions, which have changed since the content of this buffer has been
+    presented */
+    wwlRect stale[WWL_MAX_DAMAGE];
+    int stale_count;
+};
+
+typedef struct wwlOutput {
+    struct wwlContext* context;
+    struct wwlOutput* next;
+    struct wl_output* output;
+    /* The name of the global */
+    uint32_t name;
+    int scale;
+    /* The scale, which has been announced, but not yet applied by done */
+    int pending_scale;
+} wwlOutput;
+
+/**
+ * The connection to the compositor and the global objects, which are shared by
+ * all windows of the context
+ */
+typedef struct wwlContext {
     struct wl_display* display;
+    struct wl_registry* registry;
     struct wl_compositor* compositor;
     struct wl_shm* shm;
     struct xdg_wm_base* wm_base;
-    struct wl_surface* surface;
-    struct xdg_toplevel* toplevel;
     struct wl_seat* seat;
+    struct wp_presentation* presentation;
+    struct wp_viewporter* viewporter;
+    struct wp_fractional_scale_manager_v1* fractional_scale_manager;
+    struct wp_single_pixel_buffer_manager_v1* single_pixel_manager;
+    struct wl_subcompositor* subcompositor;
+    struct zwp_relative_pointer_manager_v1* relative_pointer_manager;
+    struct zwp_input_timestamps_manager_v1* input_timestamps_manager;
+    uint32_t compositor_version;
+    struct wwlOutput* outputs;
     struct wl_keyboard* keyboard;
     struct wl_pointer* pointer;
+    struct zwp_relative_pointer_v1* relative_pointer;
+    struct zwp_input_timestamps_v1* keyboard_timestamps;
+    struct zwp_input_timestamps_v1* pointer_timestamps;
+    /* The timestamp of the next key event in nanoseconds. 0, when there is none */
+    uint64_t key_timestamp;
     struct xkb_state* keyboard_state;
     struct xkb_context* keyboard_context;
     struct xkb_keymap* keyboard_keymap;
+    /* Bitmask of the active wwlModifiers */
+    uint32_t modifiers;
+
+    /* Bitmask of the wwlPixelFormats, which the compositor supports */
+    uint32_t supported_formats;
+    /* Bitmask of the wwlYUVFormats, which the compositor supports */
+    uint32_t supported_yuv;
+    clockid_t presentation_clock;
+    /* The time in nanoseconds, which the handling of the default queue took */
+    atomic_uint_least64_t dispatch_time;
+
+    struct wwlWindow* windows;
+    struct wwlWindow* keyboard_focus;
+    struct wwlWindow* pointer_focus;
+    struct pointer_event pointer_event;
+} wwlContext;
 
+typedef struct wwlWindow {
+    struct wwlContext* context;
+    /* The next window of the context */
+    struct wwlWindow* next;
+    /* The window has been created with wwlCreateWindow() */
+    int owns_context;
+    struct wl_surface* surface;
+    struct xdg_surface* xdg_surface;
+    struct xdg_toplevel* toplevel;
+    /* The window of a layer. NULL for windows */
+    struct wwlWindow* parent;
+    struct wl_subsurface* subsurface;
+    /* The commits of the layer are applied together with the commit of the window */
+    int sync;
+    /* The surface has to be committed, so the changes of its layers are shown */
+    atomic_int needs_commit;
+    /* Between wwlBeginFrame() and wwlEndFrame(). The commits are held back */
+    atomic_int in_frame;
+    /* A frame has been attached during the transaction, but not committed yet */
+    int staged;
+
+    /* The size of the buffers, which may differ from the size of the surface */
     int width;
     int height;
-    int running;
-    int damaged;
+    /* The size of the surface from the last configuration */
+    int surface_width;
+    int surface_height;
+    /* The fixed render size or the render scale. 0, when unused */
+    int render_width;
+    int render_height;
+    double render_scale;
+    struct wp_viewport* viewport;
+    /* The destination of the viewport, which has been sent. -1, when unset */
+    int viewport_width;
+    int viewport_height;
+    /* The scale of the buffers in 1/WWL_SCALE_BASE */
+    int scale;
+    /* The latest preferred scale from the compositor */
+    int preferred_scale;
+    /* A new scale for the render thread. 0, when there is none */
+    atomic_int scale_mailbox;
+    /* The buffer scale, which has been sent */
+    int buffer_scale;
+    struct wp_fractional_scale_v1* fractional_scale;
+    /* The outputs, which show the surface */
+    struct wl_output* entered[WWL_MAX_OUTPUTS];
+    int entered_count;
+    /* Shared by the event thread and the render thread */
+    atomic_int running;
+    atomic_int damaged;
+    atomic_int configured;
+    int pending_width;
+    int pending_height;
+    uint32_t configure_serial;
+    int needs_ack;
+    /* The latest configuration, which waits for the next frame callback */
+    struct wwlConfigure deferred;
+    int resize_pending;
+    /* The size from wwlGetDimensions() has changed, but resize_callback hasn't
+    been called yet */
+    int size_changed;
+    /* The time, when the pending frame callback has been requested */
+    uint64_t frame_requested;
+    /* The wwlWindowState flags and the states of the last toplevel configure,
+    which are applied with the surface configure */
+    atomic_int state;
+    int pending_state;
+    int hidden_interval;
+    /* The time, when wwlPollEventsThrottled() returned the last time */
+    uint64_t last_poll;
+
+    /* The objects, which create the frame callbacks, buffers and feedbacks. In
+    render thread mode they are wrappers, which send the events to the render
+    queue */
+    struct wl_event_queue* render_queue;
+    struct wl_display* render_display;
+    struct wl_surface* render_surface;
+    struct wl_shm* render_shm;
+    struct wp_presentation* render_presentation;
+    struct wp_single_pixel_buffer_manager_v1* render_single_pixel;
+
+    /* Triple buffer, which passes the configurations from the event thread to
+    the render thread */
+    struct wwlConfigure configures[3];
+    atomic_int configure_mailbox;
+    int configure_write;
+    int configure_read;
 
     uint32_t* content;
-    struct wl_buffer* buffer;
+    int content_width;
+    int content_height;
+    enum wwlPixelFormat format;
+    /* The frame of the last wwlDrawYUV(). yuv is false, when the content isn't a
+    video frame */
+    int yuv;
+    enum wwlYUVFormat yuv_format;
+    const uint8_t* yuv_planes[3];
+    int yuv_strides[3];
+    int yuv_width;
+    int yuv_height;
+
+    struct wl_shm_pool* pool;
+    /* The wwlMemoryFlags for new memory of the pool */
+    uint32_t memory_flags;
+    int pool_fd;
+    int pool_size;
+    uint8_t* pool_data;
+    /* The mapping of the pool, which the application got with wwlAcquireBuffer(),
+    when the pool had to grow before the buffer was presented */
+    uint8_t* acquired_pool_data;
+    int acquired_pool_size;
+    struct wwlBuffer buffers[WWL_BUFFER_COUNT];
+    struct wwlBuffer* front;
+    struct wwlBuffer* acquired;
+    /* The damaged frame waits for a buffer. It's counted once as skipped */
+    int waiting;
+    struct wl_callback* pending_frame;
+    wwlRect damage[WWL_MAX_DAMAGE];
+    int damage_count;
+
+    /* The next frame has a single color, which is shown with a 1x1 buffer */
+    int solid;
+    /* The color of solid frames and of the parts of buffers without content as
+    premultiplied ARGB8888 */
+    uint32_t clear_color;
+    /* The cached buffer of the last solid frame and its color */
+    struct wl_buffer* solid_buffer;
+    uint32_t solid_color;
+    int solid_busy;
+    /* The pixels of the single pixel buffers without
+    wp_single_pixel_buffer_manager_v1 */
+    struct wl_shm_pool* solid_pool;
+    uint32_t* solid_pool_data;
+    int solid_slot;
+
+    struct wwlFeedback feedbacks[WWL_FEEDBACK_COUNT];
+    /* Protects frame_stats and input_latency, which the render thread writes,
+    while other threads read them */
+    pthread_mutex_t stats_lock;
+    wwlFrameStats frame_stats;
+    uint8_t latency_history[WWL_LATENCY_HISTORY];
+    int latency_index;
+
+    int auto_damage;
+    uint8_t* dirty_tiles;
+    int dirty_tiles_size;
+    wwlDiffStats diff_stats;
+
+    /* The counters of wwlGetStats(). The times are written by the event thread
+    and the render thread */
+    struct wwlCounters stats;
+    atomic_uint_least64_t dispatch_time;
+    atomic_uint_least64_t callback_time;
 
     void (*key_callback)(void* window, char* key, enum wwlKeyAction action);
+    void (*keysym_callback)(void* window, uint32_t keycode, uint32_t keysym, uint32_t modifiers, uint32_t time, enum wwlKeyAction action);
+    /* The pressed keys by their unshifted keysym */
+    uint64_t keys_down[WWL_KEY_BITS / 64];
+    /* Ring buffer of input events. NULL, when the callbacks are used */
+    wwlEvent* events;
+    int event_capacity;
+    int event_head;
+    int event_count;
+    int coalesce;
+    wwlEventStats event_stats;
     void (*cursor_callback)(void* window, double x, double y);
     void (*button_callback)(void* window, int button, enum wwlKeyAction action);
     void (*scroll_callback)(void* window, double x_offset, double y_offset);
-    struct pointer_event pointer_event;
+    void (*relative_callback)(void* window, double dx, double dy, double dx_unaccel, double dy_unaccel);
+    void (*frame_callback)(void* window, uint32_t time);
+    void (*scale_callback)(void* window, double scale);
+    void (*resize_callback)(void* window, int width, int height);
+    void (*state_callback)(void* window, int state);
     double cursor_x;
     double cursor_y;
+    /* The timestamp of the input event, whose callback is running */
+    uint64_t event_time;
+
+    int trace_input;
+    /* The timestamp of the oldest traced input event since the last commit. 0,
+    when there is none */
+    atomic_uint_least64_t input_time;
+    /* The id of the last traced event in the trace file */
+    uint64_t input_id;
+    wwlInputLatency input_latency;
 } wwlWindow;
 
+/**
+ * A layer is a window object, whose surface is a subsurface of a window
+ */
+typedef wwlWindow wwlLayer;
+
+/**
+ * ==================================
+ * Trace Section
+ * ==================================
+ */
+
+/**
+ * The file of wwlSetTraceFile(). NULL, when tracing is disabled
+ */
+static FILE* _Atomic trace_file;
+
+/**
+ * Returns the time of the monotonic clock in nanoseconds
+ */
+static uint64_t get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Write a begin or end event in the Chrome trace format
+ * @file: The trace file
+ * @name: The name of the span
+ * @phase: 'B' for the begin and 'E' for the end of the span
+ */
+static void trace_write(FILE* file, const char* name, char phase) {
+    static __thread int tid;
+    if(tid == 0) {
+        tid = gettid();
+    }
+    fprintf(file, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d},\n", name, phase, get_time() / 1000.0, getpid(), tid);
+}
+
+/**
+ * Write an async span with its own start and end in the Chrome trace format.
+ * Spans with the same id are shown on one track, even when they are written by
+ * different threads
+ * @name: The name of the span
+ * @id: The id of the track
+ * @start: The start in nanoseconds of CLOCK_MONOTONIC
+ * @end: The end in nanoseconds of CLOCK_MONOTONIC
+ */
+static void trace_async(const char* name, uint64_t id, uint64_t start, uint64_t end) {
+    FILE* file = atomic_load_explicit(&trace_file, memory_order_relaxed);
+    if(file == NULL) {
+        return;
+    }
+    fprintf(file, "{\"name\":\"%s\",\"cat\":\"input\",\"ph\":\"b\",\"id\":%llu,\"ts\":%.3f,\"pid\":%d},\n", name, (unsigned long long)id, start / 1000.0, getpid());
+    fprintf(file, "{\"name\":\"%s\",\"cat\":\"input\",\"ph\":\"e\",\"id\":%llu,\"ts\":%.3f,\"pid\":%d},\n", name, (unsigned long long)id, end / 1000.0, getpid());
+}
+
+/**
+ * Begin a span of work. Costs a load and a branch, when tracing is disabled. With
+ * WWL_USDT defined, it's also a USDT probe wwl:begin
+ * @name: The name of the span
+ */
+static inline void trace_begin(const char* name) {
+#ifdef WWL_USDT
+    DTRACE_PROBE1(wwl, begin, name);
+#endif
+    FILE* file = atomic_load_explicit(&trace_file, memory_order_relaxed);
+    if(__builtin_expect(file != NULL, 0)) {
+        trace_write(file, name, 'B');
+    }
+}
+
+/**
+ * End the span, which has been started last on this thread
+ * @name: The name of the span
+ */
+static inline void trace_end(const char* name) {
+#ifdef WWL_USDT
+    DTRACE_PROBE1(wwl, end, name);
+#endif
+    FILE* file = atomic_load_explicit(&trace_file, memory_order_relaxed);
+    if(__builtin_expect(file != NULL, 0)) {
+        trace_write(file, name, 'E');
+    }
+}
+
+/**
+ * Start a call of an application callback. Returns the start time for
+ * end_callback()
+ * @name: The name of the span
+ */
+static inline uint64_t begin_callback(const char* name) {
+    trace_begin(name);
+    return get_time();
+}
+
+/**
+ * Add the time of an application callback to the counters of the window
+ * @window: The window object
+ * @name: The name of the span
+ * @start: The time from begin_callback()
+ */
+static inline void end_callback(wwlWindow* window, const char* name, uint64_t start) {
+    atomic_fetch_add_explicit(&window->callback_time, get_time() - start, memory_order_relaxed);
+    trace_end(name);
+}
+
 /**
  * ==================================
  * Shared memory section
@@ -92,25 +744,28 @@ static void randname(char *buf) {
 }
 
 /**
- * Create a shared memory file in /dev/shm
+ * Create an anonymous shared memory file. Uses memfd_create and falls back to
+ * shm_open in /dev/shm, if the kernel doesn't support it
  * @size: The size of the file
  */
 static int create_shm_file(int size) {
-    char name[] = "/wwl-XXXXXX";
-    int retries = 100;
-    int fd = -1;
+    int fd = memfd_create("wwl", MFD_CLOEXEC);
+    if(fd < 0) {
+        char name[] = "/wwl-XXXXXX";
+        int retries = 100;
 
-    do {
-        randname(name + strlen(name) - 6);
-        --retries;
-        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
-        if(fd >= 0) {
-            shm_unlink(name);
-            break;
+        do {
+            randname(name + strlen(name) - 6);
+            --retries;
+            fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+            if(fd >= 0) {
+                shm_unlink(name);
+                break;
+            }
+        } while (retries > 0 && errno == EEXIST);
+        if(fd < 0) {
+            return fd;
         }
-    } while (retries > 0 && errno == EEXIST);
-    if(fd < 0) {
-        return fd;
     }
     if(ftruncate(fd, size) < 0) {
         close(fd);
@@ -120,438 +775,4075 @@ static int create_shm_file(int size) {
 }
 
 /**
- * ==================================
- * Buffer Section
- * ==================================
+ * Returns true, when the kernel gives transparent huge pages to shared memory,
+ * which asks for them. The default setting of shmem_enabled is never, which
+ * ignores MADV_HUGEPAGE. The setting is read once
  */
+static int shmem_huge_pages(void) {
+    static atomic_int enabled = -1;
+    int value = atomic_load(&enabled);
+    if(value >= 0) {
+        return value;
+    }
+    value = 0;
+    FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/shmem_enabled", "r");
+    if(file != NULL) {
+        /* The selected setting is in brackets, like "always [advise] never" */
+        char line[128];
+        if(fgets(line, sizeof(line), file) != NULL) {
+            char* selected = strchr(line, '[');
+            value = selected != NULL && strncmp(selected, "[never]", 7) != 0 && strncmp(selected, "[deny]", 6) != 0;
+        }
+        fclose(file);
+    }
+    atomic_store(&enabled, value);
+    return value;
+}
 
 /**
- * Delete a buffer, when it's not in use anymore
+ * Apply the wwlMemoryFlags to memory, which has just been added to the pool.
+ * Huge pages have to be requested, before the pages are faulted in, so this
+ * prefaults with madvise instead of MAP_POPULATE. Every step may fail, which
+ * leaves normal pages, that are faulted in on their first use
+ * @window: The window object
+ * @offset: The start of the new memory
+ * @size: The size of the new memory
  */
-static void release_buffer(void *data, struct wl_buffer *wl_buffer) {
-    wl_buffer_destroy(wl_buffer);
+static void prepare_pool(wwlWindow* window, int offset, int size) {
+    uint8_t* data = window->pool_data + offset;
+    if((window->memory_flags & WWL_MEMORY_HUGE_PAGES) && shmem_huge_pages()) {
+        madvise(data, size, MADV_HUGEPAGE);
+    }
+    if(window->memory_flags & WWL_MEMORY_PREFAULT) {
+        int populated = 0;
+#ifdef MADV_POPULATE_WRITE
+        populated = madvise(data, size, MADV_POPULATE_WRITE) == 0;
+#endif
+        /* Kernels before 5.14 get each page touched */
+        for(int i = 0; !populated && i < size; i += 4096) {
+            data[i] = 0;
+        }
+    }
+    if(window->memory_flags & WWL_MEMORY_LOCK) {
+        mlock(data, size);
+    }
 }
 
-static struct wl_buffer_listener buffer_listener = {
-    release_buffer
-};
+/**
+ * Unmap the old mapping of the pool, once the application doesn't write into the
+ * acquired buffer anymore
+ * @window: The window object
+ */
+static void release_acquired_pool(wwlWindow* window) {
+    if(window->acquired_pool_data != NULL) {
+        munmap(window->acquired_pool_data, window->acquired_pool_size);
+        window->acquired_pool_data = NULL;
+    }
+}
 
 /**
- * Create a buffer and fill it with content
+ * Make sure, that the shared memory pool of the window is at least size bytes
+ * big. The pool only grows and is never recreated, so buffers, which are still
+ * held by the compositor, stay valid
  * @window: The window object
- * @content: The content of the buffer. When NULL, the function creates a black
- * buffer
+ * @size: The minimum size of the pool
  */
-static struct wl_buffer* createFrame(wwlWindow* window, uint32_t* content) {
-    int stride = window->width * 4;
-    int size = stride * window->height;
-    int fd = create_shm_file(size);
-    if(fd < 0) {
-        fprintf(stderr, "Couldn't create shared memory file\n");
-        return NULL;
+static int reserve_pool(wwlWindow* window, int size) {
+    if(size <= window->pool_size) {
+        return 0;
+    }
+    /* Grow with slack, so a growing window doesn't resize the pool every frame */
+    int grown = window->pool_size + window->pool_size / 2;
+    size = size + size / 4 > grown ? size + size / 4 : grown;
+    /* Without huge pages for shared memory the rounding would only waste memory */
+    int page = (window->memory_flags & WWL_MEMORY_HUGE_PAGES) && shmem_huge_pages() ? WWL_HUGE_PAGE_SIZE : 4096;
+    size = (size + page - 1) & ~(page - 1);
+    window->stats.shm_allocations++;
+
+    if(window->pool_fd < 0) {
+        window->pool_fd = create_shm_file(size);
+        if(window->pool_fd < 0) {
+            fprintf(stderr, "Couldn't create shared memory file\n");
+            return -1;
+        }
+    } else if(ftruncate(window->pool_fd, size) < 0) {
+        fprintf(stderr, "Couldn't resize shared memory file\n");
+        return -1;
     }
 
-    uint32_t* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    uint8_t* data;
+    if(window->pool_data == NULL || window->acquired != NULL) {
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, window->pool_fd, 0);
+    } else {
+        /* Keeps the pages of the old mapping instead of faulting them in again */
+        data = mremap(window->pool_data, window->pool_size, size, MREMAP_MAYMOVE);
+    }
     if(data == MAP_FAILED) {
         fprintf(stderr, "mmap failed %d %d\n", window->width, window->height);
-        close(fd);
-        return NULL;
+        return -1;
     }
+    if(window->pool_data != NULL && window->acquired != NULL) {
+        /* The application still writes into the acquired buffer through the old
+        mapping. Both map the same file, so it is kept until the buffer gets
+        presented */
+        if(window->acquired_pool_data == NULL) {
+            window->acquired_pool_data = window->pool_data;
+            window->acquired_pool_size = window->pool_size;
+        } else {
+            munmap(window->pool_data, window->pool_size);
+        }
+    }
+    window->pool_data = data;
+    prepare_pool(window, window->pool_size, size - window->pool_size);
 
-    struct wl_shm_pool* pool = wl_shm_create_pool(window->shm, fd, size);
-    struct wl_buffer* buffer = wl_shm_pool_create_buffer(pool, 0, window->width, window->height, stride, WL_SHM_FORMAT_XRGB8888);
-    wl_shm_pool_destroy(pool);
-    close(fd);
-    if(content != NULL) {
-        memcpy(data, content, size);
+    if(window->pool == NULL) {
+        window->pool = wl_shm_create_pool(window->render_shm, window->pool_fd, size);
     } else {
-        for(int i = 0; i < window->width * window->height; i++) {
-            data[i] = 0xFF000000;
-        }
+        wl_shm_pool_resize(window->pool, size);
     }
-    munmap(data, size);
-    wl_buffer_add_listener(buffer, &buffer_listener, NULL);
-    return buffer;
+    window->pool_size = size;
+    return 0;
 }
 
 /**
  * ==================================
- * Listener Section
+ * SIMD Section
  * ==================================
  */
 
-static void keyboard_keymap(void *data, struct wl_keyboard *wl_keyboard, uint32_t format, int32_t fd, uint32_t size) {
-    wwlWindow* window = data;
-    
-    if(format == WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1) {
-        char* map_shm = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
-        if(map_shm != MAP_FAILED) {
-            xkb_keymap_unref(window->keyboard_keymap);
-            xkb_state_unref(window->keyboard_state);
-            window->keyboard_keymap = xkb_keymap_new_from_string(window->keyboard_context, map_shm, XKB_KEYMAP_FORMAT_TEXT_V1, XKB_MAP_COMPILE_NO_FLAGS);
-            munmap(map_shm, size);
-            close(fd);
-            window->keyboard_state = xkb_state_new(window->keyboard_keymap);
+static int span_equal_scalar(const uint32_t* a, const uint32_t* b, int n) {
+    for(int i = 0; i < n; i++) {
+        if(a[i] != b[i]) {
+            return 0;
         }
     }
+    return 1;
 }
 
-static void keyboard_enter(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, struct wl_surface *surface, struct wl_array *keys) {
-    wwlWindow* window = data;
+static void shuffle_scalar(uint32_t* dst, const uint32_t* src, int n, const uint8_t* order) {
+    const uint8_t* s = (const uint8_t*)src;
+    uint8_t* d = (uint8_t*)dst;
+    for(int i = 0; i < n * 4; i += 4) {
+        d[i] = s[i + order[0]];
+        d[i + 1] = s[i + order[1]];
+        d[i + 2] = s[i + order[2]];
+        d[i + 3] = s[i + order[3]];
+    }
+}
 
-    if(window->key_callback != NULL) {
-        uint32_t* key;
-        wl_array_for_each(key, keys) {
-            char buf[128];
-            xkb_keysym_t sym = xkb_state_key_get_one_sym(window->keyboard_state, *key+8);
-            xkb_keysym_get_name(sym, buf, sizeof(buf));
-            window->key_callback(window, buf, WWL_KEY_PRESSED);
+static void expand_565_scalar(uint32_t* dst, const uint16_t* src, int n) {
+    for(int i = 0; i < n; i++) {
+        uint32_t r = src[i] >> 11;
+        uint32_t g = (src[i] >> 5) & 0x3F;
+        uint32_t b = src[i] & 0x1F;
+        dst[i] = 0xFF000000 | ((r << 3 | r >> 2) << 16) | ((g << 2 | g >> 4) << 8) | (b << 3 | b >> 2);
+    }
+}
+
+static void fill_span_scalar(uint32_t* dst, uint32_t color, int n) {
+    for(int i = 0; i < n; i++) {
+        dst[i] = color;
+    }
+}
+
+/**
+ * Multiply two 8 bit values and divide the result by 255 with rounding
+ */
+static inline uint32_t mul_div255(uint32_t a, uint32_t b) {
+    uint32_t t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static void blend_span_scalar(uint32_t* dst, const uint32_t* src, int n) {
+    for(int i = 0; i < n; i++) {
+        uint32_t s = src[i];
+        uint32_t ia = 255 - (s >> 24);
+        if(ia == 0) {
+            dst[i] = s;
+            continue;
+        }
+        uint32_t d = dst[i];
+        uint32_t result = 0;
+        for(int shift = 0; shift < 32; shift += 8) {
+            uint32_t c = ((s >> shift) & 0xFF) + mul_div255((d >> shift) & 0xFF, ia);
+            result |= (c > 255 ? 255 : c) << shift;
         }
+        dst[i] = result;
     }
 }
 
-static void keyboard_leave(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, struct wl_surface *surface) {
+/**
+ * Shift a color channel with 6 fractional bits down and clamp it to 8 bits
+ */
+static inline uint32_t clamp_channel(int value) {
+    value >>= 6;
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
 
+static void yuv_span_scalar(uint32_t* dst, const uint8_t* y, const uint8_t* u, const uint8_t* v, int n) {
+    for(int i = 0; i < n; i++) {
+        int luma = (y[i] - 16) * 74 + 32;
+        int cb = u[i / 2] - 128;
+        int cr = v[i / 2] - 128;
+        dst[i] = 0xFF000000 | clamp_channel(luma + 102 * cr) << 16 | clamp_channel(luma - 25 * cb - 52 * cr) << 8 | clamp_channel(luma + 129 * cb);
+    }
 }
 
-static void keyboard_key(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, uint32_t time, uint32_t key, uint32_t state) {
-    wwlWindow* window = data;
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static int span_equal_sse2(const uint32_t* a, const uint32_t* b, int n) {
+    int i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+        __m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i + 4)), _mm_loadu_si128((const __m128i*)(b + i + 4)));
+        __m128i x = _mm_or_si128(x0, x1);
+        if(_mm_movemask_epi8(_mm_cmpeq_epi32(x, _mm_setzero_si128())) != 0xFFFF) {
+            return 0;
+        }
+    }
+    return span_equal_scalar(a + i, b + i, n - i);
+}
 
-    if(window->key_callback != NULL) {
-        char buf[128];
-        uint32_t keycode = key+8;
-        xkb_keysym_t sym = xkb_state_key_get_one_sym(window->keyboard_state, keycode);
-        xkb_keysym_get_name(sym, buf, sizeof(buf));
-        enum wwlKeyAction action = state == WL_KEYBOARD_KEY_STATE_PRESSED ? WWL_KEY_PRESSED : WWL_KEY_RELEASED;
-        window->key_callback(window, buf, action);
+__attribute__((target("avx2")))
+static int span_equal_avx2(const uint32_t* a, const uint32_t* b, int n) {
+    int i = 0;
+    for(; i + 16 <= n; i += 16) {
+        __m256i x0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+        __m256i x1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i + 8)), _mm256_loadu_si256((const __m256i*)(b + i + 8)));
+        __m256i x = _mm256_or_si256(x0, x1);
+        if(!_mm256_testz_si256(x, x)) {
+            return 0;
+        }
     }
+    return span_equal_sse2(a + i, b + i, n - i);
 }
 
-static void keyboard_modifiers(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, uint32_t mods_depressed, uint32_t mods_latched, uint32_t mods_locked, uint32_t group) {
-    wwlWindow* window = data;
-    xkb_state_update_mask(window->keyboard_state, mods_depressed, mods_latched, mods_locked, 0, 0, group);
+/**
+ * Repeat the byte order of one pixel for four pixels
+ */
+__attribute__((target("ssse3")))
+static __m128i shuffle_mask(const uint8_t* order) {
+    return _mm_setr_epi8(order[0], order[1], order[2], order[3],
+            order[0] + 4, order[1] + 4, order[2] + 4, order[3] + 4,
+            order[0] + 8, order[1] + 8, order[2] + 8, order[3] + 8,
+            order[0] + 12, order[1] + 12, order[2] + 12, order[3] + 12);
 }
 
-void keyboard_repeat_info(void *data, struct wl_keyboard *wl_keyboard, int32_t rate, int32_t delay) {
+__attribute__((target("ssse3")))
+static void shuffle_ssse3(uint32_t* dst, const uint32_t* src, int n, const uint8_t* order) {
+    __m128i mask = shuffle_mask(order);
+    int i = 0;
+    for(; i + 4 <= n; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(p, mask));
+    }
+    shuffle_scalar(dst + i, src + i, n - i, order);
+}
 
+__attribute__((target("avx2")))
+static void shuffle_avx2(uint32_t* dst, const uint32_t* src, int n, const uint8_t* order) {
+    __m256i mask = _mm256_broadcastsi128_si256(shuffle_mask(order));
+    int i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(p, mask));
+    }
+    shuffle_ssse3(dst + i, src + i, n - i, order);
 }
 
-static struct wl_keyboard_listener keyboard_listener = {
-    keyboard_keymap,
-    keyboard_enter,
-    keyboard_leave,
-    keyboard_key,
-    keyboard_modifiers,
-    keyboard_repeat_info
-};
-
-static void pointer_enter(void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface, wl_fixed_t surface_x, wl_fixed_t surface_y) {
-    wwlWindow* window = data;
-    window->pointer_event.event_mask |= POINTER_EVENT_ENTER;
-    window->pointer_event.serial = serial;
-    window->pointer_event.surface_x = surface_x;
-    window->pointer_event.surface_y = surface_y;
+__attribute__((target("sse2")))
+static void expand_565_sse2(uint32_t* dst, const uint16_t* src, int n) {
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    const __m128i alpha = _mm_set1_epi16((short)0xFF00);
+    int i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i r = _mm_srli_epi16(p, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), mask6);
+        __m128i b = _mm_and_si128(p, mask5);
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+        __m128i ra = _mm_or_si128(r, alpha);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(bg, ra));
+    }
+    expand_565_scalar(dst + i, src + i, n - i);
 }
 
-static void pointer_leave(void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface) {
-    wwlWindow* window = data;
-    window->pointer_event.event_mask |= POINTER_EVENT_LEAVE;
-    window->pointer_event.serial = serial;
+__attribute__((target("avx2")))
+static void expand_565_avx2(uint32_t* dst, const uint16_t* src, int n) {
+    const __m256i mask6 = _mm256_set1_epi16(0x3F);
+    const __m256i mask5 = _mm256_set1_epi16(0x1F);
+    const __m256i alpha = _mm256_set1_epi16((short)0xFF00);
+    int i = 0;
+    for(; i + 16 <= n; i += 16) {
+        __m256i p = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i r = _mm256_srli_epi16(p, 11);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi16(p, 5), mask6);
+        __m256i b = _mm256_and_si256(p, mask5);
+        r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+        g = _mm256_or_si256(_mm256_slli_epi16(g, 2), _mm256_srli_epi16(g, 4));
+        b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+        __m256i bg = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+        __m256i ra = _mm256_or_si256(r, alpha);
+        /* The unpack instructions work on each 128 bit lane separately */
+        __m256i lo = _mm256_unpacklo_epi16(bg, ra);
+        __m256i hi = _mm256_unpackhi_epi16(bg, ra);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst + i + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    expand_565_sse2(dst + i, src + i, n - i);
 }
 
-static void pointer_motion(void *data, struct wl_pointer *wl_pointer, uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y) {
-    wwlWindow* window = data;
-    window->pointer_event.event_mask |= POINTER_EVENT_MOTION;
-    window->pointer_event.time = time;
-    window->pointer_event.surface_x = surface_x;
-    window->pointer_event.surface_y = surface_y;
+__attribute__((target("sse2")))
+static void fill_span_sse2(uint32_t* dst, uint32_t color, int n) {
+    __m128i c = _mm_set1_epi32(color);
+    int i = 0;
+    for(; i + 8 <= n; i += 8) {
+        _mm_storeu_si128((__m128i*)(dst + i), c);
+        _mm_storeu_si128((__m128i*)(dst + i + 4), c);
+    }
+    fill_span_scalar(dst + i, color, n - i);
 }
 
-static void pointer_button(void *data, struct wl_pointer *wl_pointer, uint32_t serial, uint32_t time, uint32_t button, uint32_t state) {
-    wwlWindow* window = data;
-    window->pointer_event.event_mask |= POINTER_EVENT_BUTTON;
-    window->pointer_event.time = time;
-    window->pointer_event.serial = serial;
-    window->pointer_event.button = button;
-    window->pointer_event.state = state;
+__attribute__((target("avx2")))
+static void fill_span_avx2(uint32_t* dst, uint32_t color, int n) {
+    __m256i c = _mm256_set1_epi32(color);
+    int i = 0;
+    for(; i + 16 <= n; i += 16) {
+        _mm256_storeu_si256((__m256i*)(dst + i), c);
+        _mm256_storeu_si256((__m256i*)(dst + i + 8), c);
+    }
+    fill_span_sse2(dst + i, color, n - i);
 }
 
-static void pointer_axis(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis, wl_fixed_t value) {
-    wwlWindow* window = data;
-    window->pointer_event.event_mask |= POINTER_EVENT_AXIS;
-    window->pointer_event.time = time;
-    window->pointer_event.axes[axis].valid = 1;
-    window->pointer_event.axes[axis].value = value;
+/**
+ * Blend 2 pixels, whose channels have been widened to 16 bit. alpha contains the
+ * alpha of the source pixels in every channel
+ */
+__attribute__((target("sse2")))
+static __m128i blend_half_sse2(__m128i s, __m128i d, __m128i alpha) {
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), alpha)), _mm_set1_epi16(128));
+    t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    return _mm_add_epi16(s, t);
 }
 
-static void pointer_frame(void *data, struct wl_pointer *wl_pointer) {
-    wwlWindow* window = data;
-    struct pointer_event* event = &window->pointer_event;
-
-    if(event->event_mask & POINTER_EVENT_ENTER) {
-        window->cursor_x = wl_fixed_to_double(event->surface_x);
-        window->cursor_y = wl_fixed_to_double(event->surface_y);
-        if(window->cursor_callback != NULL) {
-            window->cursor_callback(window, window->cursor_x, window->cursor_y);
+__attribute__((target("sse2")))
+static void blend_span_sse2(uint32_t* dst, const uint32_t* src, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_mask = _mm_set1_epi32(0xFF000000);
+    int i = 0;
+    for(; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i a = _mm_and_si128(s, alpha_mask);
+        int opaque = _mm_movemask_epi8(_mm_cmpeq_epi32(a, alpha_mask));
+        if(opaque == 0xFFFF) {
+            _mm_storeu_si128((__m128i*)(dst + i), s);
+            continue;
         }
-    }
-    if(event->event_mask & POINTER_EVENT_LEAVE) {
-        
-    }
-    if(event->event_mask & POINTER_EVENT_MOTION) {
-        window->cursor_x = wl_fixed_to_double(event->surface_x);
-        window->cursor_y = wl_fixed_to_double(event->surface_y);
-        if(window->cursor_callback != NULL) {
-            window->cursor_callback(window, window->cursor_x, window->cursor_y);
+        if(_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xFFFF) {
+            continue;
         }
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        /* Repeat the alpha of each pixel in its four 16 bit channels */
+        a = _mm_srli_epi32(a, 24);
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+        __m128i lo = blend_half_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(a, a));
+        __m128i hi = blend_half_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(a, a));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
     }
-    if(event->event_mask & POINTER_EVENT_BUTTON) {
-        enum wwlKeyAction action = event->state == WL_POINTER_BUTTON_STATE_PRESSED ? WWL_KEY_PRESSED : WWL_KEY_RELEASED;
-        if(window->button_callback != NULL) {
-            window->button_callback(window, event->button, action);
+    blend_span_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static __m256i blend_half_avx2(__m256i s, __m256i d, __m256i alpha) {
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), alpha)), _mm256_set1_epi16(128));
+    t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    return _mm256_add_epi16(s, t);
+}
+
+__attribute__((target("avx2")))
+static void blend_span_avx2(uint32_t* dst, const uint32_t* src, int n) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha_mask = _mm256_set1_epi32(0xFF000000);
+    int i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i a = _mm256_and_si256(s, alpha_mask);
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, alpha_mask)) == -1) {
+            _mm256_storeu_si256((__m256i*)(dst + i), s);
+            continue;
+        }
+        if(_mm256_testz_si256(s, s)) {
+            continue;
         }
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        a = _mm256_srli_epi32(a, 24);
+        a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+        /* The unpack and pack instructions stay in their 128 bit lanes, so the
+        pixels end up in their original order */
+        __m256i lo = blend_half_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi32(a, a));
+        __m256i hi = blend_half_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi32(a, a));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
     }
+    blend_span_sse2(dst + i, src + i, n - i);
+}
 
-    uint32_t axis_events = POINTER_EVENT_AXIS
-            | POINTER_EVENT_AXIS_SOURCE
-            | POINTER_EVENT_AXIS_STOP
-            | POINTER_EVENT_AXIS_DISCRETE;
-    if (event->event_mask & axis_events) {
-        if(window->scroll_callback != NULL) {
-            window->scroll_callback(window, event->axes[WL_POINTER_AXIS_VERTICAL_SCROLL].value, event->axes[WL_POINTER_AXIS_HORIZONTAL_SCROLL].value);
-        }
+/**
+ * The channels are calculated with 16 bit lanes and 6 fractional bits. Only
+ * results above 255 can saturate, so they match yuv_span_scalar()
+ */
+__attribute__((target("sse2")))
+static void yuv_span_sse2(uint32_t* dst, const uint8_t* y, const uint8_t* u, const uint8_t* v, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi8((char)0xFF);
+    int i = 0;
+    for(; i + 8 <= n; i += 8) {
+        uint32_t cb_bytes, cr_bytes;
+        memcpy(&cb_bytes, u + i / 2, 4);
+        memcpy(&cr_bytes, v + i / 2, 4);
+        __m128i cb = _mm_cvtsi32_si128(cb_bytes);
+        __m128i cr = _mm_cvtsi32_si128(cr_bytes);
+        /* Every chroma sample covers two pixels */
+        cb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(cb, cb), zero), _mm_set1_epi16(128));
+        cr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(cr, cr), zero), _mm_set1_epi16(128));
+        __m128i luma = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(y + i)), zero);
+        luma = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(luma, _mm_set1_epi16(16)), _mm_set1_epi16(74)), _mm_set1_epi16(32));
+        __m128i r = _mm_adds_epi16(luma, _mm_mullo_epi16(cr, _mm_set1_epi16(102)));
+        __m128i g = _mm_adds_epi16(_mm_adds_epi16(luma, _mm_mullo_epi16(cb, _mm_set1_epi16(-25))), _mm_mullo_epi16(cr, _mm_set1_epi16(-52)));
+        __m128i b = _mm_adds_epi16(luma, _mm_mullo_epi16(cb, _mm_set1_epi16(129)));
+        r = _mm_packus_epi16(_mm_srai_epi16(r, 6), zero);
+        g = _mm_packus_epi16(_mm_srai_epi16(g, 6), zero);
+        b = _mm_packus_epi16(_mm_srai_epi16(b, 6), zero);
+        __m128i bg = _mm_unpacklo_epi8(b, g);
+        __m128i ra = _mm_unpacklo_epi8(r, alpha);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(bg, ra));
     }
-    memset(event, 0, sizeof(*event));
+    yuv_span_scalar(dst + i, y + i, u + i / 2, v + i / 2, n - i);
 }
 
-static void pointer_axis_source(void *data, struct wl_pointer *wl_pointer, uint32_t axis_source) {
-    wwlWindow* window = data;
-    window->pointer_event.event_mask |= POINTER_EVENT_AXIS_SOURCE;
-    window->pointer_event.axis_source = axis_source;
+__attribute__((target("avx2")))
+static void yuv_span_avx2(uint32_t* dst, const uint8_t* y, const uint8_t* u, const uint8_t* v, int n) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi8((char)0xFF);
+    int i = 0;
+    for(; i + 16 <= n; i += 16) {
+        __m128i cb_bytes = _mm_loadl_epi64((const __m128i*)(u + i / 2));
+        __m128i cr_bytes = _mm_loadl_epi64((const __m128i*)(v + i / 2));
+        __m256i cb = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cb_bytes, cb_bytes)), _mm256_set1_epi16(128));
+        __m256i cr = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cr_bytes, cr_bytes)), _mm256_set1_epi16(128));
+        __m256i luma = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + i)));
+        luma = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(luma, _mm256_set1_epi16(16)), _mm256_set1_epi16(74)), _mm256_set1_epi16(32));
+        __m256i r = _mm256_adds_epi16(luma, _mm256_mullo_epi16(cr, _mm256_set1_epi16(102)));
+        __m256i g = _mm256_adds_epi16(_mm256_adds_epi16(luma, _mm256_mullo_epi16(cb, _mm256_set1_epi16(-25))), _mm256_mullo_epi16(cr, _mm256_set1_epi16(-52)));
+        __m256i b = _mm256_adds_epi16(luma, _mm256_mullo_epi16(cb, _mm256_set1_epi16(129)));
+        r = _mm256_packus_epi16(_mm256_srai_epi16(r, 6), zero);
+        g = _mm256_packus_epi16(_mm256_srai_epi16(g, 6), zero);
+        b = _mm256_packus_epi16(_mm256_srai_epi16(b, 6), zero);
+        /* The pack and unpack instructions work on each 128 bit lane separately */
+        __m256i bg = _mm256_unpacklo_epi8(b, g);
+        __m256i ra = _mm256_unpacklo_epi8(r, alpha);
+        __m256i lo = _mm256_unpacklo_epi16(bg, ra);
+        __m256i hi = _mm256_unpackhi_epi16(bg, ra);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst + i + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    yuv_span_sse2(dst + i, y + i, u + i / 2, v + i / 2, n - i);
 }
+#endif
 
-static void pointer_axis_stop(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis) {
-    wwlWindow* window = data;
-    window->pointer_event.event_mask |= POINTER_EVENT_AXIS_STOP;
-    window->pointer_event.time = time;
-    window->pointer_event.axes[axis].valid = 1;
+#if defined(__aarch64__)
+static void shuffle_neon(uint32_t* dst, const uint32_t* src, int n, const uint8_t* order) {
+    const uint8_t table[16] = {
+        order[0], order[1], order[2], order[3],
+        order[0] + 4, order[1] + 4, order[2] + 4, order[3] + 4,
+        order[0] + 8, order[1] + 8, order[2] + 8, order[3] + 8,
+        order[0] + 12, order[1] + 12, order[2] + 12, order[3] + 12
+    };
+    uint8x16_t mask = vld1q_u8(table);
+    int i = 0;
+    for(; i + 4 <= n; i += 4) {
+        uint8x16_t p = vld1q_u8((const uint8_t*)(src + i));
+        vst1q_u8((uint8_t*)(dst + i), vqtbl1q_u8(p, mask));
+    }
+    shuffle_scalar(dst + i, src + i, n - i, order);
 }
 
-static void pointer_axis_discrete(void *data, struct wl_pointer *wl_pointer, uint32_t axis, int32_t discrete) {
-    wwlWindow* window = data;
-    window->pointer_event.event_mask |= POINTER_EVENT_AXIS_DISCRETE;
-    window->pointer_event.axes[axis].valid = 1;
-    window->pointer_event.axes[axis].discrete = discrete;
+static void expand_565_neon(uint32_t* dst, const uint16_t* src, int n) {
+    int i = 0;
+    for(; i + 8 <= n; i += 8) {
+        uint16x8_t p = vld1q_u16(src + i);
+        uint8x8_t r = vmovn_u16(vshrq_n_u16(p, 11));
+        uint8x8_t g = vmovn_u16(vandq_u16(vshrq_n_u16(p, 5), vdupq_n_u16(0x3F)));
+        uint8x8_t b = vmovn_u16(vandq_u16(p, vdupq_n_u16(0x1F)));
+        uint8x8x4_t pixels;
+        pixels.val[0] = vorr_u8(vshl_n_u8(b, 3), vshr_n_u8(b, 2));
+        pixels.val[1] = vorr_u8(vshl_n_u8(g, 2), vshr_n_u8(g, 4));
+        pixels.val[2] = vorr_u8(vshl_n_u8(r, 3), vshr_n_u8(r, 2));
+        pixels.val[3] = vdup_n_u8(0xFF);
+        vst4_u8((uint8_t*)(dst + i), pixels);
+    }
+    expand_565_scalar(dst + i, src + i, n - i);
 }
 
-static struct wl_pointer_listener pointer_listener = {
-    pointer_enter,
-    pointer_leave,
-    pointer_motion,
-    pointer_button,
-    pointer_axis,
-    pointer_frame,
-    pointer_axis_source,
-    pointer_axis_stop,
-    pointer_axis_discrete
-};
+static void fill_span_neon(uint32_t* dst, uint32_t color, int n) {
+    uint32x4_t c = vdupq_n_u32(color);
+    int i = 0;
+    for(; i + 8 <= n; i += 8) {
+        vst1q_u32(dst + i, c);
+        vst1q_u32(dst + i + 4, c);
+    }
+    fill_span_scalar(dst + i, color, n - i);
+}
 
-static void seat_capabilities(void *data, struct wl_seat *wl_seat, uint32_t capabilities) {
-    wwlWindow* window = data;
+/**
+ * Multiply the channel with the inverted alpha and divide by 255 with rounding
+ */
+static uint8x8_t blend_channel_neon(uint8x8_t s, uint8x8_t d, uint8x8_t inverse) {
+    uint16x8_t t = vmull_u8(d, inverse);
+    return vqadd_u8(s, vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+}
 
-    if(window->keyboard == NULL) {
-        window->keyboard = wl_seat_get_keyboard(wl_seat);
-        wl_keyboard_add_listener(window->keyboard, &keyboard_listener, window);
+static void blend_span_neon(uint32_t* dst, const uint32_t* src, int n) {
+    int i = 0;
+    for(; i + 8 <= n; i += 8) {
+        uint8x8x4_t s = vld4_u8((const uint8_t*)(src + i));
+        uint8x8x4_t d = vld4_u8((const uint8_t*)(dst + i));
+        uint8x8_t inverse = vmvn_u8(s.val[3]);
+        for(int c = 0; c < 4; c++) {
+            d.val[c] = blend_channel_neon(s.val[c], d.val[c], inverse);
+        }
+        vst4_u8((uint8_t*)(dst + i), d);
     }
+    blend_span_scalar(dst + i, src + i, n - i);
+}
 
-    if(window->pointer == NULL) {
-        window->pointer = wl_seat_get_pointer(wl_seat);
-        wl_pointer_add_listener(window->pointer, &pointer_listener, window);
+static void yuv_span_neon(uint32_t* dst, const uint8_t* y, const uint8_t* u, const uint8_t* v, int n) {
+    int i = 0;
+    for(; i + 8 <= n; i += 8) {
+        uint32_t cb_bytes, cr_bytes;
+        memcpy(&cb_bytes, u + i / 2, 4);
+        memcpy(&cr_bytes, v + i / 2, 4);
+        uint8x8_t cb8 = vreinterpret_u8_u32(vdup_n_u32(cb_bytes));
+        uint8x8_t cr8 = vreinterpret_u8_u32(vdup_n_u32(cr_bytes));
+        int16x8_t cb = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vzip1_u8(cb8, cb8))), vdupq_n_s16(128));
+        int16x8_t cr = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vzip1_u8(cr8, cr8))), vdupq_n_s16(128));
+        int16x8_t luma = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + i)));
+        luma = vaddq_s16(vmulq_n_s16(vsubq_s16(luma, vdupq_n_s16(16)), 74), vdupq_n_s16(32));
+        uint8x8x4_t pixels;
+        pixels.val[0] = vqshrun_n_s16(vqaddq_s16(luma, vmulq_n_s16(cb, 129)), 6);
+        pixels.val[1] = vqshrun_n_s16(vqaddq_s16(vqaddq_s16(luma, vmulq_n_s16(cb, -25)), vmulq_n_s16(cr, -52)), 6);
+        pixels.val[2] = vqshrun_n_s16(vqaddq_s16(luma, vmulq_n_s16(cr, 102)), 6);
+        pixels.val[3] = vdup_n_u8(0xFF);
+        vst4_u8((uint8_t*)(dst + i), pixels);
     }
+    yuv_span_scalar(dst + i, y + i, u + i / 2, v + i / 2, n - i);
 }
+#endif
 
-static void seat_name(void *data, struct wl_seat *wl_seat, const char *name) {
+/**
+ * Compares n pixels and returns true, when they are the same
+ */
+static int (*span_equal)(const uint32_t* a, const uint32_t* b, int n) = span_equal_scalar;
 
-}
+/**
+ * Reorders the bytes of n 32 bit pixels. order contains the index of the source
+ * byte for each of the four destination bytes
+ */
+static void (*shuffle)(uint32_t* dst, const uint32_t* src, int n, const uint8_t* order) = shuffle_scalar;
 
-static struct wl_seat_listener seat_listener = {
-    seat_capabilities,
-    seat_name
-};
+/**
+ * Converts n RGB565 pixels to XRGB8888
+ */
+static void (*expand_565)(uint32_t* dst, const uint16_t* src, int n) = expand_565_scalar;
 
 /**
- * Get the global objects
+ * Sets n 32 bit pixels to the color
  */
-static void global_listener(void *data, struct wl_registry *wl_registry, uint32_t name, const char *interface, uint32_t version) {
-    wwlWindow* window = data;
-    if(strcmp(interface, wl_compositor_interface.name) == 0) {
-        window->compositor = wl_registry_bind(wl_registry, name, &wl_compositor_interface, version);
-    } else if(strcmp(interface, wl_shm_interface.name) == 0) {
-        window->shm = wl_registry_bind(wl_registry, name, &wl_shm_interface, version);
-    } else if(strcmp(interface, xdg_wm_base_interface.name) == 0) {
-        window->wm_base = wl_registry_bind(wl_registry, name, &xdg_wm_base_interface, version);
-    } else if(strcmp(interface, wl_seat_interface.name) == 0) {
-        window->seat = wl_registry_bind(wl_registry, name, &wl_seat_interface, version);
-        wl_seat_add_listener(window->seat, &seat_listener, window);
-    }
-}
+static void (*fill_span)(uint32_t* dst, uint32_t color, int n) = fill_span_scalar;
 
-static void global_remove(void *data, struct wl_registry *wl_registry, uint32_t name) {
-    /* Nada */
+/**
+ * Blends n premultiplied pixels over the destination. The alpha is the highest
+ * byte of the source pixels
+ */
+static void (*blend_span)(uint32_t* dst, const uint32_t* src, int n) = blend_span_scalar;
+
+/**
+ * Converts n pixels of BT.601 YUV with limited range to XRGB8888. Each sample of
+ * u and v covers two pixels
+ */
+static void (*yuv_span)(uint32_t* dst, const uint8_t* y, const uint8_t* u, const uint8_t* v, int n) = yuv_span_scalar;
+
+/**
+ * Choose the fastest kernels, which are supported by the CPU
+ */
+static void select_kernels(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        span_equal = span_equal_avx2;
+        shuffle = shuffle_avx2;
+        expand_565 = expand_565_avx2;
+        fill_span = fill_span_avx2;
+        blend_span = blend_span_avx2;
+        yuv_span = yuv_span_avx2;
+    } else {
+        if(__builtin_cpu_supports("sse2")) {
+            span_equal = span_equal_sse2;
+            expand_565 = expand_565_sse2;
+            fill_span = fill_span_sse2;
+            blend_span = blend_span_sse2;
+            yuv_span = yuv_span_sse2;
+        }
+        if(__builtin_cpu_supports("ssse3")) {
+            shuffle = shuffle_ssse3;
+        }
+    }
+#elif defined(__aarch64__)
+    shuffle = shuffle_neon;
+    expand_565 = expand_565_neon;
+    fill_span = fill_span_neon;
+    blend_span = blend_span_neon;
+    yuv_span = yuv_span_neon;
+#endif
 }
 
-static struct wl_registry_listener listener = {
-    global_listener,
-    global_remove
-};
+/**
+ * ==================================
+ * Damage Section
+ * ==================================
+ */
 
 /**
- * Honestly. I don't really know what's up with this function. I have to have it
- * and I have to create and attach a buffer, even if I don't want to.
+ * Returns true, when the rectangle a lies completely inside of b
  */
-static void surface_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial) {
-    wwlWindow* window = data;
-    xdg_surface_ack_configure(xdg_surface, serial);
-    window->buffer = createFrame(window, window->content);
-    wl_surface_attach(window->surface, window->buffer, 0, 0);
-    wl_surface_commit(window->surface);
+static int rect_contains(wwlRect* b, wwlRect* a) {
+    return a->x >= b->x && a->y >= b->y && a->x + a->width <= b->x + b->width && a->y + a->height <= b->y + b->height;
 }
 
-static struct xdg_surface_listener surface_listener = {
-    surface_configure
-};
+/**
+ * Clip a rectangle to the size of the window. Returns false, when nothing is
+ * left of the rectangle
+ */
+static int rect_clip(wwlRect* rect, int width, int height) {
+    if(rect->x < 0) {
+        rect->width += rect->x;
+        rect->x = 0;
+    }
+    if(rect->y < 0) {
+        rect->height += rect->y;
+        rect->y = 0;
+    }
+    if(rect->x + rect->width > width) {
+        rect->width = width - rect->x;
+    }
+    if(rect->y + rect->height > height) {
+        rect->height = height - rect->y;
+    }
+    return rect->width > 0 && rect->height > 0;
+}
 
 /**
- * Gets called when the size of the window changes
+ * Add a rectangle to a list of damaged regions. Regions, which are already
+ * covered, are skipped. When the list is full, all regions get merged into
+ * their bounding box
+ * @rects: The list of damaged regions with WWL_MAX_DAMAGE entries
+ * @count: The number of used entries in the list
+ * @rect: The new region
  */
-static void toplevel_configure(void *data, struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height, struct wl_array *states) {
-    wwlWindow* window = data;
-    if(width != 0 && height != 0) {
-        window->width = width;
-        window->height = height;
+static void add_damage(wwlRect* rects, int* count, wwlRect rect) {
+    for(int i = 0; i < *count; i++) {
+        if(rect_contains(&rects[i], &rect)) {
+            return;
+        }
+    }
+    if(*count < WWL_MAX_DAMAGE) {
+        rects[(*count)++] = rect;
+        return;
+    }
+
+    int x1 = rect.x, y1 = rect.y;
+    int x2 = rect.x + rect.width, y2 = rect.y + rect.height;
+    for(int i = 0; i < *count; i++) {
+        x1 = rects[i].x < x1 ? rects[i].x : x1;
+        y1 = rects[i].y < y1 ? rects[i].y : y1;
+        x2 = rects[i].x + rects[i].width > x2 ? rects[i].x + rects[i].width : x2;
+        y2 = rects[i].y + rects[i].height > y2 ? rects[i].y + rects[i].height : y2;
     }
+    rects[0] = (wwlRect){ x1, y1, x2 - x1, y2 - y1 };
+    *count = 1;
 }
 
 /**
- * Gets called when the window should be closed
+ * Copy a rectangle of pixels from one image to another
+ * @dst: The destination image
+ * @dst_stride: The number of bytes per row of the destination
+ * @src: The source image
+ * @src_stride: The number of bytes per row of the source
+ * @rect: The region to copy
+ * @bpp: The number of bytes per pixel
  */
-static void toplevel_close(void *data, struct xdg_toplevel *xdg_toplevel) {
-    wwlWindow* window = data;
-    window->running = 0;
+static void copy_rect(uint8_t* dst, int dst_stride, const uint8_t* src, int src_stride, wwlRect* rect, int bpp) {
+    int width = rect->width * bpp;
+    dst += rect->y * dst_stride + rect->x * bpp;
+    src += rect->y * src_stride + rect->x * bpp;
+    if(width == dst_stride && dst_stride == src_stride) {
+        memcpy(dst, src, (size_t)width * rect->height);
+        return;
+    }
+    for(int y = 0; y < rect->height; y++) {
+        memcpy(dst + y * dst_stride, src + y * src_stride, width);
+    }
 }
 
-static struct xdg_toplevel_listener toplevel_listener = {
-    toplevel_configure,
-    toplevel_close
-};
+/**
+ * Compare a new frame with the previous one in tiles and replace the damage of
+ * the window with the changed tiles. Neighbouring tiles in a row are merged and
+ * rows of tiles with the same columns are merged vertically
+ * @window: The window object
+ * @content: The new frame
+ * @previous: The previous frame with the same size
+ */
+static void diff_frame(wwlWindow* window, const uint32_t* content, const uint32_t* previous) {
+    trace_begin("diff");
+    uint64_t start = get_time();
+    int width = window->content_width;
+    int height = window->content_height;
+    int columns = (width + WWL_TILE_SIZE - 1) / WWL_TILE_SIZE;
+    int rows = (height + WWL_TILE_SIZE - 1) / WWL_TILE_SIZE;
+    if(columns > window->dirty_tiles_size) {
+        free(window->dirty_tiles);
+        window->dirty_tiles = malloc(columns);
+        window->dirty_tiles_size = columns;
+    }
+    uint8_t* dirty = window->dirty_tiles;
 
-static struct wl_callback_listener frame_listener;
+    window->damage_count = 0;
+    window->diff_stats.dirty_tiles = 0;
+    for(int row = 0; row < rows; row++) {
+        int top = row * WWL_TILE_SIZE;
+        int bottom = top + WWL_TILE_SIZE < height ? top + WWL_TILE_SIZE : height;
+        int remaining = columns;
+        memset(dirty, 0, columns);
+        for(int y = top; y < bottom && remaining > 0; y++) {
+            const uint32_t* a = content + y * width;
+            const uint32_t* b = previous + y * width;
+            for(int column = 0; column < columns; column++) {
+                int x = column * WWL_TILE_SIZE;
+                int n = x + WWL_TILE_SIZE < width ? WWL_TILE_SIZE : width - x;
+                if(!dirty[column] && !span_equal(a + x, b + x, n)) {
+                    dirty[column] = 1;
+                    remaining--;
+                }
+            }
+        }
+        window->diff_stats.dirty_tiles += columns - remaining;
 
-static void frame_done(void *data, struct wl_callback *wl_callback, uint32_t callback_data) {
-    wwlWindow* window = data;
-    
-    wl_callback_destroy(wl_callback);
-    wl_callback = wl_surface_frame(window->surface);
-    wl_callback_add_listener(wl_callback, &frame_listener, window);
+        for(int column = 0; column < columns; column++) {
+            if(!dirty[column]) {
+                continue;
+            }
+            int first = column;
+            while(column + 1 < columns && dirty[column + 1]) {
+                column++;
+            }
+            int x = first * WWL_TILE_SIZE;
+            wwlRect rect = { x, top, (column + 1) * WWL_TILE_SIZE - x, bottom - top };
+            rect_clip(&rect, width, height);
 
-    if(window->damaged) {
-        window->buffer = createFrame(window, window->content);
-        wl_surface_attach(window->surface, window->buffer, 0, 0);
-        wl_surface_damage_buffer(window->surface, 0, 0, UINT32_MAX, UINT32_MAX);
-        wl_surface_commit(window->surface);
-        window->damaged = 0;
+            int merged = 0;
+            for(int i = 0; i < window->damage_count && !merged; i++) {
+                wwlRect* other = &window->damage[i];
+                if(other->x == rect.x && other->width == rect.width && other->y + other->height == rect.y) {
+                    other->height += rect.height;
+                    merged = 1;
+                }
+            }
+            if(!merged) {
+                add_damage(window->damage, &window->damage_count, rect);
+            }
+        }
     }
+
+    window->diff_stats.tiles = columns * rows;
+    window->diff_stats.rects = window->damage_count;
+    window->diff_stats.time = get_time() - start;
+    trace_end("diff");
 }
 
-static struct wl_callback_listener frame_listener = {
-    frame_done
-};
+/**
+ * Returns true, when all pixels of a frame with 32 bit pixels have the same
+ * value. Stops at the first pixel, which differs, so frames with content are
+ * rejected quickly
+ * @content: The frame
+ * @width: The width of the frame
+ * @height: The height of the frame
+ */
+static int is_uniform(const uint32_t* content, int width, int height) {
+    if(width < 1 || height < 1 || content[0] != content[width * height - 1]) {
+        return 0;
+    }
+    if(!span_equal(content, content + 1, width - 1)) {
+        return 0;
+    }
+    for(int y = 1; y < height; y++) {
+        if(!span_equal(content, content + y * width, width)) {
+            return 0;
+        }
+    }
+    return 1;
+}
 
 /**
  * ==================================
- * API Section
+ * Presentation Section
  * ==================================
  */
-wwlWindow* wwlCreateWindow(int width, int height, const char* title) {
-    wwlWindow* window = malloc(sizeof(wwlWindow));
-    window->width = width;
-    window->height = height;
-    window->running = 1;
-    
-    window->display = wl_display_connect(NULL);
-    if(window->display == NULL) {
-        fprintf(stderr, "Couldn't find wayland display\n");
-        return NULL;
-    }
-
-    struct wl_registry* registry = wl_display_get_registry(window->display);
-    wl_registry_add_listener(registry, &listener, window);
-    wl_display_roundtrip(window->display);
-
-    window->surface = wl_compositor_create_surface(window->compositor);
-    struct xdg_surface* xdg_surface = xdg_wm_base_get_xdg_surface(window->wm_base, window->surface);
-    window->toplevel = xdg_surface_get_toplevel(xdg_surface);
-    xdg_surface_add_listener(xdg_surface, &surface_listener, window);
-    xdg_toplevel_add_listener(window->toplevel, &toplevel_listener, window);
-    xdg_toplevel_set_title(window->toplevel, title);
-    wl_surface_commit(window->surface);
 
-    struct wl_callback* cb = wl_surface_frame(window->surface);
-    wl_callback_add_listener(cb, &frame_listener, window);
+/**
+ * Add the latency of a presented frame to the statistics. The histogram only
+ * contains the last WWL_LATENCY_HISTORY frames
+ * @window: The window object
+ * @latency: The time between commit and presentation in nanoseconds
+ */
+static void record_latency(wwlWindow* window, uint64_t latency) {
+    wwlFrameStats* stats = &window->frame_stats;
+    uint64_t bucket = latency / 1000000;
+    if(bucket >= WWL_LATENCY_BUCKETS) {
+        bucket = WWL_LATENCY_BUCKETS - 1;
+    }
+    if(stats->presented >= WWL_LATENCY_HISTORY) {
+        stats->histogram[window->latency_history[window->latency_index]]--;
+    }
+    window->latency_history[window->latency_index] = bucket;
+    window->latency_index = (window->latency_index + 1) % WWL_LATENCY_HISTORY;
+    stats->histogram[bucket]++;
+    stats->presented++;
+    stats->latency = latency;
+}
 
-    window->keyboard_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+static void feedback_sync_output(void *data, struct wp_presentation_feedback *wp_presentation_feedback, struct wl_output *output) {
 
-    return window;
 }
 
-int wwlShouldClose(wwlWindow* window) {
-    return wl_display_dispatch(window->display) == -1 || !window->running;
+/**
+ * Record the latency of a traced input event, whose frame has been presented
+ * @feedback: The feedback of the frame
+ * @latency: The time between commit and presentation
+ */
+static void record_input_latency(struct wwlFeedback* feedback, uint64_t latency) {
+    wwlInputLatency* stats = &feedback->window->input_latency;
+    /* The commit time is in the clock of the input events */
+    uint64_t presented = feedback->committed + latency;
+    uint64_t to_present = presented > feedback->input ? presented - feedback->input : 0;
+    stats->presented++;
+    stats->to_present = to_present;
+    stats->total_to_present += to_present;
+    if(to_present > stats->max_to_present) {
+        stats->max_to_present = to_present;
+    }
+    trace_async("commit-to-present", feedback->input_id, feedback->committed, presented);
 }
 
-void wwlGetDimensions(wwlWindow* window, int* width, int* height) {
-    *width = window->width;
-    *height = window->height;
-}
+static void feedback_presented(void *data, struct wp_presentation_feedback *wp_presentation_feedback, uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo, uint32_t flags) {
+    struct wwlFeedback* feedback = data;
+    wwlWindow* window = feedback->window;
+    uint64_t time = ((uint64_t)tv_sec_hi << 32 | tv_sec_lo) * 1000000000 + tv_nsec;
+    uint64_t latency = time > feedback->submitted ? time - feedback->submitted : 0;
 
-int wwlDraw(wwlWindow* window, uint32_t* content, int size) {
-    if(window->width * window->height * 4 != size) {
-        fprintf(stderr, "Size doesn't match\n");
-        return -1;
+    pthread_mutex_lock(&window->stats_lock);
+    record_latency(window, latency);
+    if(feedback->input != 0) {
+        record_input_latency(feedback, latency);
     }
-    window->content = content;
-    window->damaged = 1;
-    return 0;
+    window->frame_stats.refresh = refresh;
+    /* The frame missed the first refresh after the commit */
+    if(refresh != 0 && latency > refresh) {
+        window->frame_stats.late++;
+    }
+    pthread_mutex_unlock(&window->stats_lock);
+    wp_presentation_feedback_destroy(wp_presentation_feedback);
+    feedback->feedback = NULL;
 }
 
-void wwlSetTitle(wwlWindow* window, const char* title) {
-    xdg_toplevel_set_title(window->toplevel, title);
-    wl_surface_commit(window->surface);
+static void feedback_discarded(void *data, struct wp_presentation_feedback *wp_presentation_feedback) {
+    struct wwlFeedback* feedback = data;
+    pthread_mutex_lock(&feedback->window->stats_lock);
+    feedback->window->frame_stats.dropped++;
+    pthread_mutex_unlock(&feedback->window->stats_lock);
+    if(feedback->input != 0) {
+        /* The next frame is the first one, which shows the input */
+        struct wwlFeedback* next = NULL;
+        for(int i = 0; i < WWL_FEEDBACK_COUNT; i++) {
+            struct wwlFeedback* other = &feedback->window->feedbacks[i];
+            if(other->feedback != NULL && other->committed > feedback->committed && (next == NULL || other->committed < next->committed)) {
+                next = other;
+            }
+        }
+        if(next != NULL && (next->input == 0 || next->input > feedback->input)) {
+            next->input = feedback->input;
+            next->input_id = feedback->input_id;
+        }
+    }
+    wp_presentation_feedback_destroy(wp_presentation_feedback);
+    feedback->feedback = NULL;
 }
 
-void wwlSetKeyCallback(wwlWindow* window, void (*key_callback)(void* window, char* key, enum wwlKeyAction action)) {
-    window->key_callback = key_callback;
-}
+static struct wp_presentation_feedback_listener feedback_listener = {
+    feedback_sync_output,
+    feedback_presented,
+    feedback_discarded
+};
 
-void wwlGetCursorPos(wwlWindow* window, double* x, double* y) {
-    *x = window->cursor_x;
-    *y = window->cursor_y;
+static void presentation_clock_id(void *data, struct wp_presentation *wp_presentation, uint32_t clk_id) {
+    wwlContext* context = data;
+    context->presentation_clock = clk_id;
 }
 
-void wwlSetCursorCallback(wwlWindow* window, void (*cursor_callback)(void* window, double x, double y)) {
-    window->cursor_callback = cursor_callback;
-}
+static struct wp_presentation_listener presentation_listener = {
+    presentation_clock_id
+};
 
-void wwlSetMouseButtonCallback(wwlWindow* window, void (*button_callback)(void* window, int button, enum wwlKeyAction action)) {
-    window->button_callback = button_callback;
+/**
+ * Ask for presentation feedback for the next commit. The oldest traced input
+ * event since the last commit is linked to it. Does nothing, when the compositor
+ * doesn't support wp_presentation or too many frames are pending
+ * @window: The window object
+ */
+static void request_feedback(wwlWindow* window) {
+    uint64_t committed = get_time();
+    uint64_t input = window->trace_input ? atomic_exchange(&window->input_time, 0) : 0;
+    if(input != 0) {
+        wwlInputLatency* stats = &window->input_latency;
+        pthread_mutex_lock(&window->stats_lock);
+        stats->committed++;
+        stats->to_commit = committed > input ? committed - input : 0;
+        stats->total_to_commit += stats->to_commit;
+        pthread_mutex_unlock(&window->stats_lock);
+        window->input_id++;
+        trace_async("input-to-commit", window->input_id, input, committed);
+    }
+    if(window->context->presentation == NULL) {
+        return;
+    }
+    for(int i = 0; i < WWL_FEEDBACK_COUNT; i++) {
+        struct wwlFeedback* feedback = &window->feedbacks[i];
+        if(feedback->feedback == NULL) {
+            struct timespec ts;
+            clock_gettime(window->context->presentation_clock, &ts);
+            feedback->window = window;
+            feedback->submitted = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+            feedback->committed = committed;
+            feedback->input = input;
+            feedback->input_id = window->input_id;
+            feedback->feedback = wp_presentation_feedback(window->render_presentation, window->surface);
+            wp_presentation_feedback_add_listener(feedback->feedback, &feedback_listener, feedback);
+            return;
+        }
+    }
 }
 
-void wwlSetScrollCallback(wwlWindow* window, void (*scroll_callback)(void* window, double x_offset, double y_offset)) {
-    window->scroll_callback = scroll_callback;
-}
+/**
+ * ==================================
+ * Format Section
+ * ==================================
+ */
 
-void wwlCloseWindow(wwlWindow* window) {
-    window->running = 0;
-    xdg_toplevel_destroy(window->toplevel);
+static void* buffer_data(struct wwlWindow* window, struct wwlBuffer* buffer);
+
+static const struct wwlFormatInfo {
+    uint32_t shm_format;
+    int bpp;
+    /* The format, which is used, when the compositor doesn't support it */
+    uint32_t fallback;
+    /* The source byte of each byte in the fallback format */
+    uint8_t order[4];
+} formats[] = {
+    [WWL_FORMAT_XRGB8888] = { WL_SHM_FORMAT_XRGB8888, 4, WL_SHM_FORMAT_XRGB8888, { 0, 1, 2, 3 } },
+    [WWL_FORMAT_ARGB8888] = { WL_SHM_FORMAT_ARGB8888, 4, WL_SHM_FORMAT_ARGB8888, { 0, 1, 2, 3 } },
+    [WWL_FORMAT_XBGR8888] = { WL_SHM_FORMAT_XBGR8888, 4, WL_SHM_FORMAT_XRGB8888, { 2, 1, 0, 3 } },
+    [WWL_FORMAT_ABGR8888] = { WL_SHM_FORMAT_ABGR8888, 4, WL_SHM_FORMAT_ARGB8888, { 2, 1, 0, 3 } },
+    [WWL_FORMAT_RGBX8888] = { WL_SHM_FORMAT_RGBX8888, 4, WL_SHM_FORMAT_XRGB8888, { 1, 2, 3, 0 } },
+    [WWL_FORMAT_RGBA8888] = { WL_SHM_FORMAT_RGBA8888, 4, WL_SHM_FORMAT_ARGB8888, { 1, 2, 3, 0 } },
+    [WWL_FORMAT_BGRX8888] = { WL_SHM_FORMAT_BGRX8888, 4, WL_SHM_FORMAT_XRGB8888, { 3, 2, 1, 0 } },
+    [WWL_FORMAT_BGRA8888] = { WL_SHM_FORMAT_BGRA8888, 4, WL_SHM_FORMAT_ARGB8888, { 3, 2, 1, 0 } },
+    [WWL_FORMAT_RGB565] = { WL_SHM_FORMAT_RGB565, 2, WL_SHM_FORMAT_XRGB8888, { 0, 0, 0, 0 } }
+};
+
+#define WWL_FORMAT_COUNT (sizeof(formats) / sizeof(formats[0]))
+
+/**
+ * The shm formats of the wwlYUVFormats
+ */
+static const uint32_t yuv_formats[] = {
+    [WWL_YUV_NV12] = WL_SHM_FORMAT_NV12,
+    [WWL_YUV_I420] = WL_SHM_FORMAT_YUV420,
+    [WWL_YUV_YUYV] = WL_SHM_FORMAT_YUYV
+};
+
+#define WWL_YUV_FORMAT_COUNT (sizeof(yuv_formats) / sizeof(yuv_formats[0]))
+
+/**
+ * Collect the formats, which the compositor supports
+ */
+static void shm_format(void *data, struct wl_shm *wl_shm, uint32_t format) {
+    wwlContext* context = data;
+    for(unsigned int i = 0; i < WWL_FORMAT_COUNT; i++) {
+        if(formats[i].shm_format == format) {
+            context->supported_formats |= 1 << i;
+        }
+    }
+    for(unsigned int i = 0; i < WWL_YUV_FORMAT_COUNT; i++) {
+        if(yuv_formats[i] == format) {
+            context->supported_yuv |= 1 << i;
+        }
+    }
+}
+
+static struct wl_shm_listener shm_listener = {
+    shm_format
+};
+
+/**
+ * Returns the format of the buffers. This is the format of the content, when
+ * the compositor supports it, and otherwise the format, which it gets converted
+ * to
+ * @window: The window object
+ */
+static uint32_t buffer_format(wwlWindow* window) {
+    if(window->yuv) {
+        if(window->context->supported_yuv & (1 << window->yuv_format)) {
+            return yuv_formats[window->yuv_format];
+        }
+        return WL_SHM_FORMAT_XRGB8888;
+    }
+    if(window->context->supported_formats & (1 << window->format)) {
+        return formats[window->format].shm_format;
+    }
+    return formats[window->format].fallback;
+}
+
+/**
+ * Returns the number of bytes per pixel of a buffer format
+ */
+static int format_bpp(uint32_t format) {
+    return format == WL_SHM_FORMAT_RGB565 ? 2 : 4;
+}
+
+/**
+ * Returns the number of bytes of a buffer. The planes of the YUV formats follow
+ * each other and the U and V planes of WL_SHM_FORMAT_YUV420 have half the stride
+ * @format: The format of the buffer
+ * @width: The width in pixels. It has to be even for the YUV formats
+ * @height: The height in pixels. It has to be even for the YUV formats
+ * @stride: A pointer, where the number of bytes per row of the first plane will
+ * be written
+ */
+static int buffer_size(uint32_t format, int width, int height, int* stride) {
+    if(format == WL_SHM_FORMAT_NV12 || format == WL_SHM_FORMAT_YUV420) {
+        *stride = width;
+        return width * height / 2 * 3;
+    }
+    if(format == WL_SHM_FORMAT_YUYV) {
+        *stride = width * 2;
+        return *stride * height;
+    }
+    *stride = width * format_bpp(format);
+    return *stride * height;
+}
+
+/**
+ * Convert an ARGB8888 color into a pixel of a buffer format
+ * @format: The format of the buffer
+ * @color: The color
+ */
+static uint32_t convert_color(uint32_t format, uint32_t color) {
+    if(format == WL_SHM_FORMAT_RGB565) {
+        return (color >> 8 & 0xF800) | (color >> 5 & 0x07E0) | (color >> 3 & 0x001F);
+    }
+    for(unsigned int i = 0; i < WWL_FORMAT_COUNT; i++) {
+        if(formats[i].shm_format == format) {
+            /* The reverse of the conversion into the fallback format */
+            uint8_t argb[4], pixel[4];
+            memcpy(argb, &color, 4);
+            for(int j = 0; j < 4; j++) {
+                pixel[formats[i].order[j]] = argb[j];
+            }
+            memcpy(&color, pixel, 4);
+            break;
+        }
+    }
+    return color;
+}
+
+/**
+ * Fill a rectangle of an image with a color
+ * @dst: The image
+ * @stride: The number of bytes per row
+ * @rect: The region to fill
+ * @format: The format of the image
+ * @color: The color as ARGB8888
+ */
+static void fill_color(uint8_t* dst, int stride, wwlRect* rect, uint32_t format, uint32_t color) {
+    uint32_t pixel = convert_color(format, color);
+    int bpp = format_bpp(format);
+    for(int y = rect->y; y < rect->y + rect->height; y++) {
+        uint8_t* row = dst + y * stride + rect->x * bpp;
+        if(bpp == 2) {
+            for(int x = 0; x < rect->width; x++) {
+                ((uint16_t*)row)[x] = pixel;
+            }
+            continue;
+        }
+        fill_span((uint32_t*)row, pixel, rect->width);
+    }
+}
+
+/**
+ * Copy a rectangle of the content into a buffer and convert the pixels, when the
+ * buffer has a different format
+ * @window: The window object
+ * @buffer: The buffer
+ * @rect: The region to copy. It has to be inside of the content and the buffer
+ */
+static void upload_rect(wwlWindow* window, struct wwlBuffer* buffer, wwlRect* rect) {
+    const struct wwlFormatInfo* info = &formats[window->format];
+    int src_stride = window->content_width * info->bpp;
+    uint8_t* dst = buffer_data(window, buffer);
+    const uint8_t* src = (const uint8_t*)window->content;
+    window->stats.bytes_uploaded += (uint64_t)rect->width * rect->height * format_bpp(buffer->format);
+    if(buffer->format == info->shm_format) {
+        copy_rect(dst, buffer->stride, src, src_stride, rect, info->bpp);
+        return;
+    }
+
+    dst += rect->y * buffer->stride + rect->x * 4;
+    src += rect->y * src_stride + rect->x * info->bpp;
+    for(int y = 0; y < rect->height; y++) {
+        if(window->format == WWL_FORMAT_RGB565) {
+            expand_565((uint32_t*)dst, (const uint16_t*)src, rect->width);
+        } else {
+            shuffle((uint32_t*)dst, (const uint32_t*)src, rect->width, info->order);
+        }
+        dst += buffer->stride;
+        src += src_stride;
+    }
+}
+
+/**
+ * ==================================
+ * YUV Section
+ * ==================================
+ */
+
+/**
+ * The threads, which convert large video frames together with the calling
+ * thread. Each frame is split into bands, which the threads take one after
+ * another. The workers are started with the first large frame and sleep between
+ * the frames
+ */
+static struct wwlWorkers {
+    pthread_once_t once;
+    /* Only one frame is converted at a time */
+    pthread_mutex_t busy;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    int count;
+    /* Incremented for every job, so the workers notice a new one */
+    uint64_t generation;
+    /* The number of workers, which haven't finished the job yet */
+    int running;
+    void (*job)(void* data, int band, int bands);
+    void* data;
+    int bands;
+    atomic_int next_band;
+} workers = { PTHREAD_ONCE_INIT, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+/**
+ * Process bands of the current job, until none are left
+ */
+static void run_bands(void) {
+    int band;
+    while((band = atomic_fetch_add(&workers.next_band, 1)) < workers.bands) {
+        workers.job(workers.data, band, workers.bands);
+    }
+}
+
+static void* worker_main(void* data) {
+    uint64_t generation = 0;
+    pthread_mutex_lock(&workers.lock);
+    for(;;) {
+        while(workers.generation == generation) {
+            pthread_cond_wait(&workers.start, &workers.lock);
+        }
+        generation = workers.generation;
+        pthread_mutex_unlock(&workers.lock);
+        run_bands();
+        pthread_mutex_lock(&workers.lock);
+        if(--workers.running == 0) {
+            pthread_cond_signal(&workers.done);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Start a worker for every other CPU. Without workers the calling thread does
+ * all the work
+ */
+static void start_workers(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while(workers.count < cpus - 1 && workers.count < WWL_MAX_WORKERS) {
+        pthread_t thread;
+        if(pthread_create(&thread, &attr, worker_main, NULL) != 0) {
+            break;
+        }
+        workers.count++;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+/**
+ * Run a job on the calling thread and the workers. Returns, when all bands are
+ * done
+ * @job: The function, which processes a band
+ * @data: The argument of the job
+ */
+static void run_parallel(void (*job)(void* data, int band, int bands), void* data) {
+    pthread_once(&workers.once, start_workers);
+    pthread_mutex_lock(&workers.busy);
+    pthread_mutex_lock(&workers.lock);
+    workers.job = job;
+    workers.data = data;
+    workers.bands = workers.count + 1;
+    atomic_store(&workers.next_band, 0);
+    workers.running = workers.count;
+    workers.generation++;
+    pthread_cond_broadcast(&workers.start);
+    pthread_mutex_unlock(&workers.lock);
+
+    run_bands();
+    pthread_mutex_lock(&workers.lock);
+    while(workers.running > 0) {
+        pthread_cond_wait(&workers.done, &workers.lock);
+    }
+    pthread_mutex_unlock(&workers.lock);
+    pthread_mutex_unlock(&workers.busy);
+}
+
+/**
+ * Convert a row of the video frame to XRGB8888
+ * @window: The window object
+ * @dst: The row in the buffer
+ * @row: The index of the row
+ */
+static void convert_yuv_row(wwlWindow* window, uint32_t* dst, int row) {
+    const uint8_t* const* planes = window->yuv_planes;
+    const int* strides = window->yuv_strides;
+    int width = window->yuv_width;
+    if(window->yuv_format == WWL_YUV_I420) {
+        yuv_span(dst, planes[0] + row * strides[0], planes[1] + row / 2 * strides[1], planes[2] + row / 2 * strides[2], width);
+        return;
+    }
+
+    uint8_t luma[WWL_YUV_CHUNK], cb[WWL_YUV_CHUNK / 2], cr[WWL_YUV_CHUNK / 2];
+    for(int x = 0; x < width; x += WWL_YUV_CHUNK) {
+        int n = width - x < WWL_YUV_CHUNK ? width - x : WWL_YUV_CHUNK;
+        if(window->yuv_format == WWL_YUV_NV12) {
+            const uint8_t* uv = planes[1] + row / 2 * strides[1] + x;
+            for(int i = 0; i < n / 2; i++) {
+                cb[i] = uv[i * 2];
+                cr[i] = uv[i * 2 + 1];
+            }
+            yuv_span(dst + x, planes[0] + row * strides[0] + x, cb, cr, n);
+        } else {
+            const uint8_t* yuyv = planes[0] + row * strides[0] + x * 2;
+            for(int i = 0; i < n / 2; i++) {
+                luma[i * 2] = yuyv[i * 4];
+                cb[i] = yuyv[i * 4 + 1];
+                luma[i * 2 + 1] = yuyv[i * 4 + 2];
+                cr[i] = yuyv[i * 4 + 3];
+            }
+            yuv_span(dst + x, luma, cb, cr, n);
+        }
+    }
+}
+
+/**
+ * Convert a band of rows of the video frame into a buffer
+ * @data: The buffer
+ * @band: The index of the band
+ * @bands: The number of bands
+ */
+static void convert_yuv_band(void* data, int band, int bands) {
+    struct wwlBuffer* buffer = data;
+    wwlWindow* window = buffer->window;
+    uint8_t* dst = buffer_data(window, buffer);
+    int end = (int64_t)window->yuv_height * (band + 1) / bands;
+    for(int row = (int64_t)window->yuv_height * band / bands; row < end; row++) {
+        convert_yuv_row(window, (uint32_t*)(dst + row * buffer->stride), row);
+    }
+}
+
+/**
+ * Write the video frame into a buffer. The planes are copied, when the buffer
+ * has the format of the frame, and converted otherwise
+ * @window: The window object
+ * @buffer: The buffer with the size of the frame
+ */
+static void upload_yuv(wwlWindow* window, struct wwlBuffer* buffer) {
+    uint8_t* dst = buffer_data(window, buffer);
+    const uint8_t* const* planes = window->yuv_planes;
+    const int* strides = window->yuv_strides;
+    int width = window->yuv_width;
+    int height = window->yuv_height;
+    window->stats.bytes_uploaded += buffer->size;
+    if(buffer->format == WL_SHM_FORMAT_XRGB8888) {
+        if(width * height < WWL_PARALLEL_PIXELS) {
+            convert_yuv_band(buffer, 0, 1);
+        } else {
+            run_parallel(convert_yuv_band, buffer);
+        }
+        return;
+    }
+
+    wwlRect luma = { 0, 0, window->yuv_format == WWL_YUV_YUYV ? width * 2 : width, height };
+    copy_rect(dst, buffer->stride, planes[0], strides[0], &luma, 1);
+    dst += buffer->stride * height;
+    if(window->yuv_format == WWL_YUV_NV12) {
+        wwlRect chroma = { 0, 0, width, height / 2 };
+        copy_rect(dst, buffer->stride, planes[1], strides[1], &chroma, 1);
+    } else if(window->yuv_format == WWL_YUV_I420) {
+        wwlRect chroma = { 0, 0, width / 2, height / 2 };
+        copy_rect(dst, buffer->stride / 2, planes[1], strides[1], &chroma, 1);
+        copy_rect(dst + buffer->stride / 2 * chroma.height, buffer->stride / 2, planes[2], strides[2], &chroma, 1);
+    }
+}
+
+/**
+ * ==================================
+ * Buffer Section
+ * ==================================
+ */
+
+/**
+ * Mark a buffer as free, when the compositor doesn't use it anymore
+ */
+static int present(struct wwlWindow* window);
+
+static void release_buffer(void *data, struct wl_buffer *wl_buffer) {
+    struct wwlBuffer* buffer = data;
+    buffer->busy = 0;
+    if(buffer->window->damaged && buffer->window->pending_frame == NULL) {
+        present(buffer->window);
+    }
+}
+
+static struct wl_buffer_listener buffer_listener = {
+    release_buffer
+};
+
+/**
+ * Returns the pixels of a buffer in the mapped pool
+ * @window: The window object
+ * @buffer: The buffer
+ */
+static void* buffer_data(wwlWindow* window, struct wwlBuffer* buffer) {
+    return window->pool_data + buffer->offset;
+}
+
+/**
+ * Returns true, when the memory of a buffer slot overlaps with a buffer, which
+ * is still held by the compositor. This can happen after the slots have been
+ * rearranged because of a resize
+ * @window: The window object
+ * @offset: The start of the slot in the pool
+ * @size: The size of the slot
+ */
+static int slot_in_use(wwlWindow* window, int offset, int size) {
+    for(int i = 0; i < WWL_BUFFER_COUNT; i++) {
+        struct wwlBuffer* buffer = &window->buffers[i];
+        if(buffer->busy && buffer->offset < offset + size && offset < buffer->offset + buffer->size) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Get a buffer from the swapchain, which isn't used by the compositor. Prefers
+ * the buffer with the most recent content. Returns NULL, when all buffers are
+ * busy
+ * @window: The window object
+ */
+static struct wwlBuffer* acquire_buffer(wwlWindow* window) {
+    uint32_t format = buffer_format(window);
+    /* Video frames keep their size and the viewport scales them */
+    int width = window->yuv ? window->yuv_width : window->width;
+    int height = window->yuv ? window->yuv_height : window->height;
+    int stride;
+    int size = buffer_size(format, width, height, &stride);
+    if(reserve_pool(window, size * WWL_BUFFER_COUNT) < 0) {
+        return NULL;
+    }
+
+    struct wwlBuffer* best = NULL;
+    for(int i = 0; i < WWL_BUFFER_COUNT; i++) {
+        struct wwlBuffer* buffer = &window->buffers[i];
+        if(buffer->busy) {
+            continue;
+        }
+        if(buffer->buffer != NULL && (buffer->width != width || buffer->height != height || buffer->format != format)) {
+            wl_buffer_destroy(buffer->buffer);
+            buffer->buffer = NULL;
+        }
+        if(buffer->buffer == NULL) {
+            buffer->offset = size * i;
+            buffer->age = 0;
+            buffer->stale_count = 0;
+            if(slot_in_use(window, buffer->offset, size)) {
+                continue;
+            }
+        }
+        if(best == NULL || (buffer->age != 0 && (best->age == 0 || buffer->age < best->age))) {
+            best = buffer;
+        }
+    }
+    if(best == NULL) {
+        return NULL;
+    }
+
+    if(best->buffer == NULL) {
+        best->window = window;
+        best->width = width;
+        best->height = height;
+        best->stride = stride;
+        best->size = size;
+        best->format = format;
+        best->buffer = wl_shm_pool_create_buffer(window->pool, best->offset, best->width, best->height, best->stride, best->format);
+        wl_buffer_add_listener(best->buffer, &buffer_listener, best);
+    }
+    return best;
+}
+
+/**
+ * Fill a buffer with content
+ * @window: The window object
+ * @buffer: The buffer
+ * @content: The content of the buffer. When NULL, the buffer gets filled with the
+ * clear color. When the size of the content doesn't match the buffer, the
+ * overlapping part is copied and the rest gets the clear color
+ */
+static void fill_buffer(wwlWindow* window, struct wwlBuffer* buffer, uint32_t* content) {
+    uint8_t* data = buffer_data(window, buffer);
+    wwlRect rect = { 0, 0, buffer->width, buffer->height };
+    if(content == NULL || !rect_clip(&rect, window->content_width, window->content_height)) {
+        rect = (wwlRect){ 0, 0, buffer->width, buffer->height };
+        fill_color(data, buffer->stride, &rect, buffer->format, window->clear_color);
+        return;
+    }
+
+    upload_rect(window, buffer, &rect);
+    if(rect.width < buffer->width) {
+        wwlRect right = { rect.width, 0, buffer->width - rect.width, rect.height };
+        fill_color(data, buffer->stride, &right, buffer->format, window->clear_color);
+    }
+    if(rect.height < buffer->height) {
+        wwlRect bottom = { 0, rect.height, buffer->width, buffer->height - rect.height };
+        fill_color(data, buffer->stride, &bottom, buffer->format, window->clear_color);
+    }
+}
+
+/**
+ * Bring a buffer up to date with the last presented frame and copy the damaged
+ * regions of the content into it. Buffers with undefined content are filled
+ * completely
+ * @window: The window object
+ * @buffer: The buffer
+ */
+static void update_buffer(wwlWindow* window, struct wwlBuffer* buffer) {
+    struct wwlBuffer* front = window->front;
+    if(window->yuv) {
+        /* Every video frame replaces the whole buffer */
+        upload_yuv(window, buffer);
+        window->damage[0] = (wwlRect){ 0, 0, buffer->width, buffer->height };
+        window->damage_count = 1;
+        return;
+    }
+    if(buffer->age == 0 || front == NULL || front->width != buffer->width || front->height != buffer->height || front->format != buffer->format) {
+        fill_buffer(window, buffer, window->content);
+        window->damage[0] = (wwlRect){ 0, 0, buffer->width, buffer->height };
+        window->damage_count = 1;
+        return;
+    }
+
+    uint8_t* data = buffer_data(window, buffer);
+    if(buffer != front) {
+        uint8_t* front_data = buffer_data(window, front);
+        for(int i = 0; i < buffer->stale_count; i++) {
+            int covered = 0;
+            for(int j = 0; j < window->damage_count && !covered; j++) {
+                covered = rect_contains(&window->damage[j], &buffer->stale[i]);
+            }
+            if(!covered) {
+                copy_rect(data, buffer->stride, front_data, front->stride, &buffer->stale[i], format_bpp(buffer->format));
+                window->stats.bytes_uploaded += (uint64_t)buffer->stale[i].width * buffer->stale[i].height * format_bpp(buffer->format);
+            }
+        }
+    }
+
+    for(int i = 0; i < window->damage_count; i++) {
+        wwlRect rect = window->damage[i];
+        if(window->content == NULL) {
+            /* Cleared with wwlClear() */
+            if(rect_clip(&rect, buffer->width, buffer->height)) {
+                fill_color(data, buffer->stride, &rect, buffer->format, window->clear_color);
+            }
+        } else if(rect_clip(&rect, window->content_width, window->content_height)) {
+            upload_rect(window, buffer, &rect);
+        }
+    }
+}
+
+static struct wl_callback_listener frame_listener;
+
+/**
+ * Ask the compositor for a frame callback with the next commit, if none is
+ * pending yet
+ * @window: The window object
+ */
+static void request_frame(wwlWindow* window) {
+    if(window->pending_frame == NULL) {
+        window->frame_requested = get_time();
+        window->pending_frame = wl_surface_frame(window->render_surface);
+        wl_callback_add_listener(window->pending_frame, &frame_listener, window);
+    }
+}
+
+/**
+ * Calculate the size of the buffers from the size of the surface and the render
+ * resolution. Without a viewport, the buffers always have the size of the surface
+ * @window: The window object
+ */
+static void update_render_size(wwlWindow* window) {
+    /* The native size of the surface on its output */
+    int width = (window->surface_width * window->scale + WWL_SCALE_BASE / 2) / WWL_SCALE_BASE;
+    int height = (window->surface_height * window->scale + WWL_SCALE_BASE / 2) / WWL_SCALE_BASE;
+    if(window->viewport != NULL && window->render_width > 0) {
+        width = window->render_width;
+        height = window->render_height;
+    } else if(window->viewport != NULL && window->render_scale > 0) {
+        width = (int)(width * window->render_scale + 0.5);
+        height = (int)(height * window->render_scale + 0.5);
+        width = width > 0 ? width : 1;
+        height = height > 0 ? height : 1;
+    }
+    if(width != window->width || height != window->height) {
+        window->width = width;
+        window->height = height;
+        window->damaged = 1;
+        window->size_changed = 1;
+    }
+}
+
+/**
+ * Tell the application about the new size, right before the next frame gets
+ * drawn. Several changes in between only call resize_callback once
+ * @window: The window object
+ */
+static void notify_resize(wwlWindow* window) {
+    if(!window->size_changed) {
+        return;
+    }
+    window->size_changed = 0;
+    if(window->resize_callback != NULL) {
+        uint64_t start = begin_callback("resize_callback");
+        window->resize_callback(window, window->width, window->height);
+        end_callback(window, "resize_callback", start);
+    }
+}
+
+/**
+ * Let the compositor scale the buffer to the size of the surface, when their
+ * sizes differ. The destination only gets sent, when it has changed. Without a
+ * viewport, only integer scales are possible with the buffer scale
+ * @window: The window object
+ * @width: The width of the buffer, which gets attached
+ * @height: The height of the buffer, which gets attached
+ */
+static void update_viewport(wwlWindow* window, int width, int height) {
+    if(window->viewport == NULL) {
+        int scale = window->scale / WWL_SCALE_BASE;
+        if(scale != window->buffer_scale && window->context->compositor_version >= 3) {
+            wl_surface_set_buffer_scale(window->surface, scale);
+            window->buffer_scale = scale;
+        }
+        return;
+    }
+    if(width != window->surface_width || height != window->surface_height) {
+        width = window->surface_width;
+        height = window->surface_height;
+    } else {
+        width = -1;
+        height = -1;
+    }
+    if(width != window->viewport_width || height != window->viewport_height) {
+        wp_viewport_set_destination(window->viewport, width, height);
+        window->viewport_width = width;
+        window->viewport_height = height;
+    }
+}
+
+/**
+ * Update the state of the window right before its surface gets committed. Changes,
+ * which the event thread makes meanwhile, set needs_commit again and are
+ * committed later. The frame of a synchronized layer only appears with the next
+ * commit of its window
+ * @window: The window object
+ */
+static void prepare_commit(wwlWindow* window) {
+    window->needs_commit = 0;
+    if(window->parent != NULL && window->sync) {
+        window->parent->needs_commit = 1;
+    }
+}
+
+/**
+ * Returns true, when the window or the window of the layer is inside of a
+ * transaction from wwlBeginFrame()
+ * @window: The window object
+ */
+static int in_frame(wwlWindow* window) {
+    return window->in_frame || (window->parent != NULL && window->parent->in_frame);
+}
+
+/**
+ * Forget the frame, which has been attached during the transaction. It never
+ * reaches the compositor, so its buffer won't be released
+ * @window: The window object
+ */
+static void unstage(wwlWindow* window) {
+    if(!window->staged) {
+        return;
+    }
+    if(window->front != NULL) {
+        window->front->busy = 0;
+    } else {
+        window->solid_busy = 0;
+    }
+    window->staged = 0;
+    window->stats.frames--;
+}
+
+/**
+ * Commit the attached frame together with a frame callback and the presentation
+ * feedback. Inside of a transaction the frame stays attached until wwlEndFrame()
+ * @window: The window object
+ */
+static void commit_frame(wwlWindow* window) {
+    window->waiting = 0;
+    if(in_frame(window)) {
+        window->staged = 1;
+        return;
+    }
+    request_frame(window);
+    request_feedback(window);
+    prepare_commit(window);
+    wl_surface_commit(window->surface);
+    window->staged = 0;
+}
+
+/**
+ * Attach a filled buffer to the surface, damage the regions of the frame and
+ * commit it
+ * @window: The window object
+ * @buffer: The buffer with the new frame
+ */
+static void commit_buffer(wwlWindow* window, struct wwlBuffer* buffer) {
+    trace_begin("commit");
+    unstage(window);
+    for(int i = 0; i < WWL_BUFFER_COUNT; i++) {
+        struct wwlBuffer* other = &window->buffers[i];
+        if(other != buffer && other->age != 0) {
+            other->age++;
+            for(int j = 0; j < window->damage_count; j++) {
+                add_damage(other->stale, &other->stale_count, window->damage[j]);
+            }
+        }
+    }
+    buffer->age = 1;
+    buffer->stale_count = 0;
+    buffer->busy = 1;
+    window->front = buffer;
+
+    if(window->needs_ack) {
+        xdg_surface_ack_configure(window->xdg_surface, window->configure_serial);
+        window->needs_ack = 0;
+    }
+    update_viewport(window, buffer->width, buffer->height);
+    wl_surface_attach(window->surface, buffer->buffer, 0, 0);
+    for(int i = 0; i < window->damage_count; i++) {
+        wwlRect* rect = &window->damage[i];
+        wl_surface_damage_buffer(window->surface, rect->x, rect->y, rect->width, rect->height);
+    }
+    window->damage_count = 0;
+    window->damaged = 0;
+    window->stats.frames++;
+    commit_frame(window);
+    trace_end("commit");
+}
+
+static void release_solid(void *data, struct wl_buffer *wl_buffer) {
+    wwlWindow* window = data;
+    /* The buffer has been replaced by another color, while it was busy */
+    if(window == NULL) {
+        wl_buffer_destroy(wl_buffer);
+        return;
+    }
+    window->solid_busy = 0;
+}
+
+static struct wl_buffer_listener solid_listener = {
+    release_solid
+};
+
+/**
+ * Returns a 1x1 buffer with the clear color of the window. The buffer of the last
+ * solid frame is reused, when the color hasn't changed. Uses
+ * wp_single_pixel_buffer_manager_v1 and falls back to a pixel in a small pool
+ * of shared memory. Returns NULL on error
+ * @window: The window object
+ */
+static struct wl_buffer* solid_buffer(wwlWindow* window) {
+    uint32_t color = window->clear_color;
+    if(window->solid_buffer != NULL && window->solid_color == color) {
+        return window->solid_buffer;
+    }
+    if(window->solid_buffer != NULL) {
+        if(window->solid_busy) {
+            /* Let the release event destroy it */
+            wl_buffer_set_user_data(window->solid_buffer, NULL);
+        } else {
+            wl_buffer_destroy(window->solid_buffer);
+        }
+        window->solid_buffer = NULL;
+    }
+
+    struct wl_buffer* buffer;
+    if(window->render_single_pixel != NULL) {
+        /* The channels are scaled from 8 to 32 bits */
+        buffer = wp_single_pixel_buffer_manager_v1_create_u32_rgba_buffer(window->render_single_pixel,
+                (color >> 16 & 0xFF) * 0x01010101, (color >> 8 & 0xFF) * 0x01010101, (color & 0xFF) * 0x01010101, (color >> 24) * 0x01010101);
+    } else {
+        if(window->solid_pool == NULL) {
+            int fd = create_shm_file(WWL_SOLID_POOL_SIZE);
+            if(fd < 0) {
+                fprintf(stderr, "Couldn't create shared memory file\n");
+                return NULL;
+            }
+            window->solid_pool_data = mmap(NULL, WWL_SOLID_POOL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if(window->solid_pool_data == MAP_FAILED) {
+                fprintf(stderr, "mmap failed\n");
+                window->solid_pool_data = NULL;
+                close(fd);
+                return NULL;
+            }
+            window->solid_pool = wl_shm_create_pool(window->render_shm, fd, WWL_SOLID_POOL_SIZE);
+            window->stats.shm_allocations++;
+            close(fd);
+        }
+        /* A pixel, which the compositor may still read, is only reused after all
+        other pixels of the pool */
+        int slot = window->solid_slot;
+        window->solid_slot = (slot + 1) % (WWL_SOLID_POOL_SIZE / 4);
+        window->solid_pool_data[slot] = color;
+        buffer = wl_shm_pool_create_buffer(window->solid_pool, slot * 4, 1, 1, 4, WL_SHM_FORMAT_ARGB8888);
+    }
+    wl_buffer_add_listener(buffer, &solid_listener, window);
+    window->solid_buffer = buffer;
+    window->solid_color = color;
+    return buffer;
+}
+
+/**
+ * Show the clear color on the whole window with a 1x1 buffer, which the viewport
+ * scales to the size of the surface. The content of the buffers of the swapchain
+ * isn't on screen anymore afterwards. Returns -1, when the buffer couldn't be
+ * created
+ * @window: The window object
+ */
+static int commit_solid(wwlWindow* window) {
+    /* A staged pixel with another color is destroyed right away */
+    unstage(window);
+    struct wl_buffer* buffer = solid_buffer(window);
+    if(buffer == NULL) {
+        return -1;
+    }
+    trace_begin("commit");
+    for(int i = 0; i < WWL_BUFFER_COUNT; i++) {
+        window->buffers[i].age = 0;
+        window->buffers[i].stale_count = 0;
+    }
+    window->front = NULL;
+    window->solid_busy = 1;
+
+    if(window->needs_ack) {
+        xdg_surface_ack_configure(window->xdg_surface, window->configure_serial);
+        window->needs_ack = 0;
+    }
+    update_viewport(window, 1, 1);
+    wl_surface_attach(window->surface, buffer, 0, 0);
+    wl_surface_damage_buffer(window->surface, 0, 0, 1, 1);
+    window->damage_count = 0;
+    window->damaged = 0;
+    window->stats.frames++;
+    commit_frame(window);
+    trace_end("commit");
+    return 0;
+}
+
+/**
+ * Copy the damaged regions of the current content into a free buffer and commit
+ * it to the surface. When all buffers are busy, the window stays damaged and
+ * the frame is presented, as soon as a buffer gets released. Solid frames are
+ * shown with a single pixel, when the window has a viewport. Inside of a
+ * transaction the frame is presented by wwlEndFrame()
+ * @window: The window object
+ */
+static int present(wwlWindow* window) {
+    if(in_frame(window)) {
+        window->damaged = 1;
+        return 0;
+    }
+    if(window->solid && window->viewport != NULL && commit_solid(window) == 0) {
+        return 0;
+    }
+    struct wwlBuffer* buffer = acquire_buffer(window);
+    if(buffer == NULL) {
+        window->damaged = 1;
+        if(!window->waiting) {
+            window->stats.skipped++;
+            window->waiting = 1;
+        }
+        return -1;
+    }
+
+    trace_begin("upload");
+    update_buffer(window, buffer);
+    trace_end("upload");
+    commit_buffer(window, buffer);
+    return 0;
+}
+
+/**
+ * ==================================
+ * Render Thread Section
+ * ==================================
+ */
+
+static void wakeup_done(void *data, struct wl_callback *wl_callback, uint32_t callback_data) {
+    wl_callback_destroy(wl_callback);
+}
+
+static struct wl_callback_listener wakeup_listener = {
+    wakeup_done
+};
+
+/**
+ * Send an event to the render queue, in case the render thread is waiting
+ * @window: The window object
+ */
+static void wake_render_thread(wwlWindow* window) {
+    struct wl_callback* callback = wl_display_sync(window->render_display);
+    wl_callback_add_listener(callback, &wakeup_listener, NULL);
+    wl_display_flush(window->context->display);
+}
+
+/**
+ * Ask for a commit of the changes, which aren't part of a frame. The commit is
+ * sent by the thread, which presents the window, so it never splits a frame of
+ * the render thread
+ * @window: The window object
+ */
+static void request_commit(wwlWindow* window) {
+    window->needs_commit = 1;
+    if(window->render_queue != NULL) {
+        wake_render_thread(window);
+    }
+}
+
+/**
+ * Commit the changes, which aren't part of a frame, like the positions of the
+ * layers or the regions
+ * @window: The window object
+ */
+static void commit_changes(wwlWindow* window) {
+    if(window->needs_commit && window->configured && !in_frame(window)) {
+        prepare_commit(window);
+        wl_surface_commit(window->surface);
+    }
+}
+
+/**
+ * Pass a configuration from the event thread to the render thread. Only the
+ * latest configuration is kept, so the render thread acknowledges at most one
+ * configuration per frame
+ * @window: The window object
+ * @serial: The serial of the configure event
+ */
+static void publish_configure(wwlWindow* window, uint32_t serial) {
+    struct wwlConfigure* configure = &window->configures[window->configure_write];
+    configure->serial = serial;
+    configure->width = window->pending_width;
+    configure->height = window->pending_height;
+    window->configure_write = atomic_exchange(&window->configure_mailbox, window->configure_write | WWL_MAILBOX_NEW) & ~WWL_MAILBOX_NEW;
+    wake_render_thread(window);
+}
+
+/**
+ * Apply the latest configuration on the render thread. It gets acknowledged with
+ * the next commit. Returns true, when there was a new configuration
+ * @window: The window object
+ */
+static int take_configure(wwlWindow* window) {
+    if(window->render_queue == NULL) {
+        return 0;
+    }
+    int scale = atomic_exchange(&window->scale_mailbox, 0);
+    if(scale != 0) {
+        window->scale = scale;
+        update_render_size(window);
+    }
+    if(!(atomic_load(&window->configure_mailbox) & WWL_MAILBOX_NEW)) {
+        notify_resize(window);
+        return 0;
+    }
+    window->configure_read = atomic_exchange(&window->configure_mailbox, window->configure_read) & ~WWL_MAILBOX_NEW;
+    struct wwlConfigure* configure = &window->configures[window->configure_read];
+    window->surface_width = configure->width;
+    window->surface_height = configure->height;
+    update_render_size(window);
+    window->configure_serial = configure->serial;
+    window->needs_ack = 1;
+    window->configured = 1;
+    window->damaged = 1;
+    notify_resize(window);
+    return 1;
+}
+
+/**
+ * Handle the events of a queue like wl_display_dispatch_queue() does, but only
+ * measure the time of the handlers and not the time of waiting. Returns the
+ * number of handled events or -1 on error
+ * @context: The context
+ * @queue: The queue or NULL for the default queue
+ * @block: True, when the function should wait for events, if none are queued
+ * @time: The counter, which the time in nanoseconds is added to
+ */
+static int dispatch_queue(wwlContext* context, struct wl_event_queue* queue, int block, atomic_uint_least64_t* time) {
+    struct wl_display* display = context->display;
+    if(block && (queue != NULL ? wl_display_prepare_read_queue(display, queue) : wl_display_prepare_read(display)) == 0) {
+        if(wl_display_flush(display) == -1 && errno != EAGAIN) {
+            wl_display_cancel_read(display);
+            return -1;
+        }
+        struct pollfd fd = { wl_display_get_fd(display), POLLIN, 0 };
+        int ret;
+        do {
+            ret = poll(&fd, 1, -1);
+        } while(ret == -1 && errno == EINTR);
+        if(ret == -1) {
+            wl_display_cancel_read(display);
+            return -1;
+        }
+        if(wl_display_read_events(display) == -1) {
+            return -1;
+        }
+    }
+    trace_begin("dispatch");
+    uint64_t start = get_time();
+    int ret = queue != NULL ? wl_display_dispatch_queue_pending(display, queue) : wl_display_dispatch_pending(display);
+    atomic_fetch_add_explicit(time, get_time() - start, memory_order_relaxed);
+    trace_end("dispatch");
+    return ret;
+}
+
+/**
+ * Handle the events of the render queue. Waits for events, when block is true
+ * @window: The window object
+ * @block: True, when the function should wait for at least one event
+ */
+static int dispatch_render_queue(wwlWindow* window, int block) {
+    return dispatch_queue(window->context, window->render_queue, block, &window->dispatch_time);
+}
+
+/**
+ * ==================================
+ * Raster Section
+ * ==================================
+ */
+
+/**
+ * Returns the acquired buffer or acquires a new one. Waits for the window to be
+ * configured the first time. Returns NULL, when all buffers are busy
+ * @window: The window object
+ */
+static struct wwlBuffer* back_buffer(wwlWindow* window) {
+    take_configure(window);
+    while(!window->configured) {
+        if(window->render_queue != NULL) {
+            if(dispatch_render_queue(window, 1) == -1) {
+                return NULL;
+            }
+            take_configure(window);
+        } else if(dispatch_queue(window->context, NULL, 1, &window->context->dispatch_time) == -1) {
+            return NULL;
+        }
+    }
+
+    struct wwlBuffer* buffer = window->acquired;
+    if(buffer == NULL) {
+        /* Drawing into the buffer ends the video */
+        window->yuv = 0;
+        buffer = acquire_buffer(window);
+        /* The render thread can wait for a release without blocking the input */
+        while(buffer == NULL && window->render_queue != NULL) {
+            if(dispatch_render_queue(window, 1) == -1) {
+                return NULL;
+            }
+            buffer = acquire_buffer(window);
+        }
+        if(buffer == NULL) {
+            return NULL;
+        }
+        /* Keep the buffer away from the event handlers until it's presented */
+        buffer->busy = 1;
+        window->acquired = buffer;
+        window->solid = 0;
+    }
+    return buffer;
+}
+
+/**
+ * Returns the back buffer for the raster functions. A newly acquired buffer
+ * gets the content of the last frame first, so the raster functions only have to
+ * touch the changed pixels. A buffer, which the application acquired itself, is
+ * used as it is
+ * @window: The window object
+ */
+static struct wwlBuffer* raster_buffer(wwlWindow* window) {
+    if(window->acquired != NULL) {
+        return window->acquired;
+    }
+    struct wwlBuffer* buffer = back_buffer(window);
+    if(buffer == NULL || buffer->age == 1) {
+        return buffer;
+    }
+
+    uint8_t* data = buffer_data(window, buffer);
+    struct wwlBuffer* front = window->front;
+    if(buffer->age == 0 || front == NULL || front->width != buffer->width || front->height != buffer->height || front->format != buffer->format) {
+        wwlRect rect = { 0, 0, buffer->width, buffer->height };
+        if(front != NULL && front->width == buffer->width && front->height == buffer->height && front->format == buffer->format) {
+            copy_rect(data, buffer->stride, buffer_data(window, front), front->stride, &rect, format_bpp(buffer->format));
+        } else {
+            fill_color(data, buffer->stride, &rect, buffer->format, window->clear_color);
+            add_damage(window->damage, &window->damage_count, rect);
+        }
+    } else {
+        uint8_t* front_data = buffer_data(window, front);
+        for(int i = 0; i < buffer->stale_count; i++) {
+            copy_rect(data, buffer->stride, front_data, front->stride, &buffer->stale[i], format_bpp(buffer->format));
+        }
+    }
+    /* The buffer contains the last frame now */
+    buffer->age = 1;
+    buffer->stale_count = 0;
+    return buffer;
+}
+
+/**
+ * Clip a rectangle, which is drawn from a source image, to the buffer. The
+ * source position is moved by the clipped amount. Returns false, when nothing is
+ * left of the rectangle
+ * @buffer: The buffer
+ * @rect: The region in the buffer
+ * @src_x: The x position in the source image
+ * @src_y: The y position in the source image
+ */
+static int clip_source(struct wwlBuffer* buffer, wwlRect* rect, int* src_x, int* src_y) {
+    int x = rect->x;
+    int y = rect->y;
+    if(!rect_clip(rect, buffer->width, buffer->height)) {
+        return 0;
+    }
+    *src_x = rect->x - x;
+    *src_y = rect->y - y;
+    return 1;
+}
+
+/**
+ * ==================================
+ * Listener Section
+ * ==================================
+ */
+
+/**
+ * Returns the window of a surface or NULL, when the surface doesn't belong to
+ * the context. The surface of a layer belongs to its window
+ * @context: The context
+ * @surface: The surface
+ */
+static wwlWindow* find_window(wwlContext* context, struct wl_surface* surface) {
+    for(wwlWindow* window = context->windows; window != NULL; window = window->next) {
+        if(window->surface == surface) {
+            return window->parent != NULL ? window->parent : window;
+        }
+    }
+    return NULL;
+}
+
+static void keyboard_keymap(void *data, struct wl_keyboard *wl_keyboard, uint32_t format, int32_t fd, uint32_t size) {
+    wwlContext* context = data;
+    
+    if(format == WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1) {
+        char* map_shm = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if(map_shm != MAP_FAILED) {
+            trace_begin("keymap");
+            xkb_keymap_unref(context->keyboard_keymap);
+            xkb_state_unref(context->keyboard_state);
+            context->keyboard_keymap = xkb_keymap_new_from_string(context->keyboard_context, map_shm, XKB_KEYMAP_FORMAT_TEXT_V1, XKB_MAP_COMPILE_NO_FLAGS);
+            munmap(map_shm, size);
+            close(fd);
+            context->keyboard_state = xkb_state_new(context->keyboard_keymap);
+            trace_end("keymap");
+        }
+    }
+}
+
+/**
+ * Returns the timestamp of an input event in nanoseconds of CLOCK_MONOTONIC or 0,
+ * when it has none. The 32 bit milliseconds wrap around after 49 days, so the
+ * missing high bits are taken from the current time
+ * @time: The timestamp of the event in milliseconds
+ * @precise: The timestamp from zwp_input_timestamps_v1 or 0
+ */
+static uint64_t event_timestamp(uint32_t time, uint64_t precise) {
+    if(precise != 0 || time == 0) {
+        return precise;
+    }
+    uint64_t now = get_time() / 1000000;
+    uint64_t ms = (now & ~(uint64_t)0xFFFFFFFF) | time;
+    if(ms > now + 0x80000000 && ms >= 0x100000000) {
+        ms -= 0x100000000;
+    }
+    return ms * 1000000;
+}
+
+/**
+ * Remember the timestamp of an input event for wwlGetEventTime() and for the
+ * input tracer, which keeps the oldest event until the next commit
+ * @window: The window object
+ * @timestamp: The timestamp of the event in nanoseconds
+ */
+static void note_input(wwlWindow* window, uint64_t timestamp) {
+    window->event_time = timestamp;
+    if(window->trace_input && timestamp != 0) {
+        uint64_t none = 0;
+        atomic_compare_exchange_strong(&window->input_time, &none, timestamp);
+    }
+}
+
+/**
+ * Adds the event to the ring buffer of the window. Consecutive motion or scroll
+ * events are merged into the newest event, when coalescing is enabled for them.
+ * When the ring buffer is full, the event is dropped
+ * @window: The window object
+ * @event: The event
+ */
+static void queue_event(wwlWindow* window, const wwlEvent* event) {
+    if(window->event_count > 0) {
+        wwlEvent* last = &window->events[(window->event_head + window->event_count - 1) % window->event_capacity];
+        if(last->type == event->type && event->type == WWL_EVENT_MOTION && (window->coalesce & WWL_COALESCE_MOTION)) {
+            last->time = event->time;
+            last->timestamp = event->timestamp;
+            last->motion = event->motion;
+            window->event_stats.coalesced++;
+            return;
+        }
+        if(last->type == event->type && event->type == WWL_EVENT_SCROLL && (window->coalesce & WWL_COALESCE_SCROLL)) {
+            last->time = event->time;
+            last->timestamp = event->timestamp;
+            last->scroll.x_offset += event->scroll.x_offset;
+            last->scroll.y_offset += event->scroll.y_offset;
+            window->event_stats.coalesced++;
+            return;
+        }
+        if(last->type == event->type && event->type == WWL_EVENT_RELATIVE_MOTION && (window->coalesce & WWL_COALESCE_RELATIVE)) {
+            last->time = event->time;
+            last->timestamp = event->timestamp;
+            last->relative.dx += event->relative.dx;
+            last->relative.dy += event->relative.dy;
+            last->relative.dx_unaccel += event->relative.dx_unaccel;
+            last->relative.dy_unaccel += event->relative.dy_unaccel;
+            window->event_stats.coalesced++;
+            return;
+        }
+    }
+    if(window->event_count == window->event_capacity) {
+        window->event_stats.dropped++;
+        return;
+    }
+    window->events[(window->event_head + window->event_count) % window->event_capacity] = *event;
+    window->event_count++;
+    window->event_stats.queued++;
+}
+
+/**
+ * Returns the slot of the keysym in the key-down bitmap or -1, when the keysym
+ * isn't tracked. Letters are tracked by their lower case keysym
+ * @sym: The keysym
+ */
+static int key_slot(xkb_keysym_t sym) {
+    sym = xkb_keysym_to_lower(sym);
+    if(sym < 0x100) {
+        return sym;
+    }
+    if(sym >= 0xff00 && sym <= 0xffff) {
+        return 0x100 + (sym & 0xff);
+    }
+    return -1;
+}
+
+/**
+ * Updates the key-down bitmap of the window. The keysym of the first shift
+ * level is used, so the release of a key clears the same slot as its press,
+ * even when the modifiers have changed in between
+ * @window: The window object
+ * @keycode: The xkb keycode
+ * @pressed: True, when the key has been pressed
+ */
+static void update_key_down(wwlWindow* window, uint32_t keycode, int pressed) {
+    wwlContext* context = window->context;
+    const xkb_keysym_t* syms;
+    xkb_layout_index_t layout = xkb_state_key_get_layout(context->keyboard_state, keycode);
+    int count = xkb_keymap_key_get_syms_by_level(context->keyboard_keymap, keycode, layout, 0, &syms);
+    if(count != 1) {
+        return;
+    }
+    int slot = key_slot(syms[0]);
+    if(slot == -1) {
+        return;
+    }
+    if(pressed) {
+        window->keys_down[slot / 64] |= (uint64_t) 1 << (slot % 64);
+    } else {
+        window->keys_down[slot / 64] &= ~((uint64_t) 1 << (slot % 64));
+    }
+}
+
+/**
+ * Updates the key-down bitmap and calls the key callbacks of the window. The
+ * name of the keysym is only formatted, when the callback with names is set
+ * @window: The window object
+ * @keycode: The xkb keycode
+ * @time: The timestamp of the event in milliseconds
+ * @timestamp: The timestamp of the event in nanoseconds
+ * @action: Either pressed or released
+ */
+static void handle_key(wwlWindow* window, uint32_t keycode, uint32_t time, uint64_t timestamp, enum wwlKeyAction action) {
+    wwlContext* context = window->context;
+    update_key_down(window, keycode, action == WWL_KEY_PRESSED);
+    note_input(window, timestamp);
+    if(window->events == NULL && window->key_callback == NULL && window->keysym_callback == NULL) {
+        return;
+    }
+    xkb_keysym_t sym = xkb_state_key_get_one_sym(context->keyboard_state, keycode);
+    if(window->events != NULL) {
+        wwlEvent event = { .type = WWL_EVENT_KEY, .time = time, .timestamp = timestamp };
+        event.key.keycode = keycode;
+        event.key.keysym = sym;
+        event.key.modifiers = context->modifiers;
+        event.key.action = action;
+        queue_event(window, &event);
+        return;
+    }
+    uint64_t start = begin_callback("key_callback");
+    if(window->keysym_callback != NULL) {
+        window->keysym_callback(window, keycode, sym, context->modifiers, time, action);
+    }
+    if(window->key_callback != NULL) {
+        char buf[128];
+        xkb_keysym_get_name(sym, buf, sizeof(buf));
+        window->key_callback(window, buf, action);
+    }
+    end_callback(window, "key_callback", start);
+}
+
+static void keyboard_enter(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, struct wl_surface *surface, struct wl_array *keys) {
+    wwlContext* context = data;
+    wwlWindow* window = find_window(context, surface);
+    context->keyboard_focus = window;
+
+    if(window != NULL && context->keyboard_state != NULL) {
+        uint32_t* key;
+        wl_array_for_each(key, keys) {
+            handle_key(window, *key+8, 0, 0, WWL_KEY_PRESSED);
+        }
+    }
+}
+
+static void keyboard_leave(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, struct wl_surface *surface) {
+    wwlContext* context = data;
+    if(context->keyboard_focus != NULL) {
+        /* The window doesn't receive the releases of the held keys anymore */
+        memset(context->keyboard_focus->keys_down, 0, sizeof(context->keyboard_focus->keys_down));
+    }
+    context->keyboard_focus = NULL;
+}
+
+static void keyboard_key(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, uint32_t time, uint32_t key, uint32_t state) {
+    wwlContext* context = data;
+    wwlWindow* window = context->keyboard_focus;
+
+    uint64_t timestamp = event_timestamp(time, context->key_timestamp);
+    context->key_timestamp = 0;
+    if(window != NULL && context->keyboard_state != NULL) {
+        enum wwlKeyAction action = state == WL_KEYBOARD_KEY_STATE_PRESSED ? WWL_KEY_PRESSED : WWL_KEY_RELEASED;
+        handle_key(window, key+8, time, timestamp, action);
+    }
+}
+
+static void keyboard_modifiers(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, uint32_t mods_depressed, uint32_t mods_latched, uint32_t mods_locked, uint32_t group) {
+    wwlContext* context = data;
+    if(context->keyboard_state == NULL) {
+        return;
+    }
+    xkb_state_update_mask(context->keyboard_state, mods_depressed, mods_latched, mods_locked, 0, 0, group);
+
+    /* Translate the modifiers once here instead of on every key event */
+    static const struct {
+        const char* name;
+        uint32_t modifier;
+    } names[] = {
+        { XKB_MOD_NAME_SHIFT, WWL_MOD_SHIFT },
+        { XKB_MOD_NAME_CTRL, WWL_MOD_CTRL },
+        { XKB_MOD_NAME_ALT, WWL_MOD_ALT },
+        { XKB_MOD_NAME_LOGO, WWL_MOD_SUPER },
+        { XKB_MOD_NAME_CAPS, WWL_MOD_CAPS_LOCK },
+        { XKB_MOD_NAME_NUM, WWL_MOD_NUM_LOCK }
+    };
+    context->modifiers = 0;
+    for(size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if(xkb_state_mod_name_is_active(context->keyboard_state, names[i].name, XKB_STATE_MODS_EFFECTIVE) > 0) {
+            context->modifiers |= names[i].modifier;
+        }
+    }
+}
+
+void keyboard_repeat_info(void *data, struct wl_keyboard *wl_keyboard, int32_t rate, int32_t delay) {
+
+}
+
+static struct wl_keyboard_listener keyboard_listener = {
+    keyboard_keymap,
+    keyboard_enter,
+    keyboard_leave,
+    keyboard_key,
+    keyboard_modifiers,
+    keyboard_repeat_info
+};
+
+static void pointer_enter(void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface, wl_fixed_t surface_x, wl_fixed_t surface_y) {
+    wwlContext* context = data;
+    context->pointer_focus = find_window(context, surface);
+    context->pointer_event.event_mask |= POINTER_EVENT_ENTER;
+    context->pointer_event.serial = serial;
+    context->pointer_event.surface_x = surface_x;
+    context->pointer_event.surface_y = surface_y;
+}
+
+static void pointer_leave(void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface) {
+    wwlContext* context = data;
+    context->pointer_focus = NULL;
+    context->pointer_event.event_mask |= POINTER_EVENT_LEAVE;
+    context->pointer_event.serial = serial;
+}
+
+static void pointer_motion(void *data, struct wl_pointer *wl_pointer, uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y) {
+    wwlContext* context = data;
+    context->pointer_event.event_mask |= POINTER_EVENT_MOTION;
+    context->pointer_event.time = time;
+    context->pointer_event.surface_x = surface_x;
+    context->pointer_event.surface_y = surface_y;
+}
+
+static void pointer_button(void *data, struct wl_pointer *wl_pointer, uint32_t serial, uint32_t time, uint32_t button, uint32_t state) {
+    wwlContext* context = data;
+    context->pointer_event.event_mask |= POINTER_EVENT_BUTTON;
+    context->pointer_event.time = time;
+    context->pointer_event.serial = serial;
+    context->pointer_event.button = button;
+    context->pointer_event.state = state;
+}
+
+static void pointer_axis(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis, wl_fixed_t value) {
+    wwlContext* context = data;
+    context->pointer_event.event_mask |= POINTER_EVENT_AXIS;
+    context->pointer_event.time = time;
+    context->pointer_event.axes[axis].valid = 1;
+    context->pointer_event.axes[axis].value = value;
+}
+
+static void pointer_frame(void *data, struct wl_pointer *wl_pointer) {
+    wwlContext* context = data;
+    wwlWindow* window = context->pointer_focus;
+    struct pointer_event* event = &context->pointer_event;
+
+    if(window == NULL) {
+        memset(event, 0, sizeof(*event));
+        return;
+    }
+    uint64_t timestamp = event_timestamp(event->time, event->timestamp);
+    if(event->event_mask & ~(POINTER_EVENT_ENTER | POINTER_EVENT_LEAVE)) {
+        note_input(window, timestamp);
+    }
+    if(event->event_mask & (POINTER_EVENT_ENTER | POINTER_EVENT_MOTION)) {
+        window->cursor_x = wl_fixed_to_double(event->surface_x);
+        window->cursor_y = wl_fixed_to_double(event->surface_y);
+        if(window->events != NULL) {
+            wwlEvent motion = { .type = WWL_EVENT_MOTION, .time = event->time, .timestamp = timestamp };
+            motion.motion.x = window->cursor_x;
+            motion.motion.y = window->cursor_y;
+            queue_event(window, &motion);
+        } else if(window->cursor_callback != NULL) {
+            uint64_t start = begin_callback("cursor_callback");
+            window->cursor_callback(window, window->cursor_x, window->cursor_y);
+            end_callback(window, "cursor_callback", start);
+        }
+    }
+    if(event->event_mask & POINTER_EVENT_LEAVE) {
+        
+    }
+    if(event->event_mask & POINTER_EVENT_BUTTON) {
+        enum wwlKeyAction action = event->state == WL_POINTER_BUTTON_STATE_PRESSED ? WWL_KEY_PRESSED : WWL_KEY_RELEASED;
+        if(window->events != NULL) {
+            wwlEvent button = { .type = WWL_EVENT_BUTTON, .time = event->time, .timestamp = timestamp };
+            button.button.button = event->button;
+            button.button.action = action;
+            queue_event(window, &button);
+        } else if(window->button_callback != NULL) {
+            uint64_t start = begin_callback("button_callback");
+            window->button_callback(window, event->button, action);
+            end_callback(window, "button_callback", start);
+        }
+    }
+
+    uint32_t axis_events = POINTER_EVENT_AXIS
+            | POINTER_EVENT_AXIS_SOURCE
+            | POINTER_EVENT_AXIS_STOP
+            | POINTER_EVENT_AXIS_DISCRETE;
+    if (event->event_mask & axis_events) {
+        if(window->events != NULL) {
+            wwlEvent scroll = { .type = WWL_EVENT_SCROLL, .time = event->time, .timestamp = timestamp };
+            scroll.scroll.x_offset = event->axes[WL_POINTER_AXIS_HORIZONTAL_SCROLL].value;
+            scroll.scroll.y_offset = event->axes[WL_POINTER_AXIS_VERTICAL_SCROLL].value;
+            queue_event(window, &scroll);
+        } else if(window->scroll_callback != NULL) {
+            uint64_t start = begin_callback("scroll_callback");
+            window->scroll_callback(window, event->axes[WL_POINTER_AXIS_VERTICAL_SCROLL].value, event->axes[WL_POINTER_AXIS_HORIZONTAL_SCROLL].value);
+            end_callback(window, "scroll_callback", start);
+        }
+    }
+    if(event->event_mask & POINTER_EVENT_RELATIVE) {
+        double dx = wl_fixed_to_double(event->dx);
+        double dy = wl_fixed_to_double(event->dy);
+        double dx_unaccel = wl_fixed_to_double(event->dx_unaccel);
+        double dy_unaccel = wl_fixed_to_double(event->dy_unaccel);
+        if(window->events != NULL) {
+            wwlEvent relative = { .type = WWL_EVENT_RELATIVE_MOTION, .time = event->time, .timestamp = timestamp };
+            relative.relative.dx = dx;
+            relative.relative.dy = dy;
+            relative.relative.dx_unaccel = dx_unaccel;
+            relative.relative.dy_unaccel = dy_unaccel;
+            queue_event(window, &relative);
+        } else if(window->relative_callback != NULL) {
+            uint64_t start = begin_callback("relative_callback");
+            window->relative_callback(window, dx, dy, dx_unaccel, dy_unaccel);
+            end_callback(window, "relative_callback", start);
+        }
+    }
+    memset(event, 0, sizeof(*event));
+}
+
+static void pointer_axis_source(void *data, struct wl_pointer *wl_pointer, uint32_t axis_source) {
+    wwlContext* context = data;
+    context->pointer_event.event_mask |= POINTER_EVENT_AXIS_SOURCE;
+    context->pointer_event.axis_source = axis_source;
+}
+
+static void pointer_axis_stop(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis) {
+    wwlContext* context = data;
+    context->pointer_event.event_mask |= POINTER_EVENT_AXIS_STOP;
+    context->pointer_event.time = time;
+    context->pointer_event.axes[axis].valid = 1;
+}
+
+static void pointer_axis_discrete(void *data, struct wl_pointer *wl_pointer, uint32_t axis, int32_t discrete) {
+    wwlContext* context = data;
+    context->pointer_event.event_mask |= POINTER_EVENT_AXIS_DISCRETE;
+    context->pointer_event.axes[axis].valid = 1;
+    context->pointer_event.axes[axis].discrete = discrete;
+}
+
+static struct wl_pointer_listener pointer_listener = {
+    pointer_enter,
+    pointer_leave,
+    pointer_motion,
+    pointer_button,
+    pointer_axis,
+    pointer_frame,
+    pointer_axis_source,
+    pointer_axis_stop,
+    pointer_axis_discrete
+};
+
+/**
+ * Relative motion is part of the next pointer frame. Its timestamp has an
+ * undefined base, so the frame keeps the timestamp of the pointer events
+ */
+static void relative_motion(void *data, struct zwp_relative_pointer_v1 *zwp_relative_pointer_v1, uint32_t utime_hi, uint32_t utime_lo, wl_fixed_t dx, wl_fixed_t dy, wl_fixed_t dx_unaccel, wl_fixed_t dy_unaccel) {
+    wwlContext* context = data;
+    struct pointer_event* event = &context->pointer_event;
+    event->event_mask |= POINTER_EVENT_RELATIVE;
+    event->dx += dx;
+    event->dy += dy;
+    event->dx_unaccel += dx_unaccel;
+    event->dy_unaccel += dy_unaccel;
+}
+
+static struct zwp_relative_pointer_v1_listener relative_pointer_listener = {
+    relative_motion
+};
+
+/**
+ * The high resolution timestamp, which is sent before the key event it belongs to
+ */
+static void keyboard_timestamp(void *data, struct zwp_input_timestamps_v1 *zwp_input_timestamps_v1, uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec) {
+    wwlContext* context = data;
+    context->key_timestamp = ((uint64_t)tv_sec_hi << 32 | tv_sec_lo) * 1000000000 + tv_nsec;
+}
+
+static struct zwp_input_timestamps_v1_listener keyboard_timestamps_listener = {
+    keyboard_timestamp
+};
+
+static void pointer_timestamp(void *data, struct zwp_input_timestamps_v1 *zwp_input_timestamps_v1, uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec) {
+    wwlContext* context = data;
+    context->pointer_event.timestamp = ((uint64_t)tv_sec_hi << 32 | tv_sec_lo) * 1000000000 + tv_nsec;
+}
+
+static struct zwp_input_timestamps_v1_listener pointer_timestamps_listener = {
+    pointer_timestamp
+};
+
+/**
+ * Create the relative pointer and the input timestamps, as soon as both the
+ * input devices and the globals are there. The globals can be announced before
+ * or after the capabilities of the seat
+ * @context: The context
+ */
+static void setup_input_extensions(wwlContext* context) {
+    if(context->pointer != NULL && context->relative_pointer_manager != NULL && context->relative_pointer == NULL) {
+        context->relative_pointer = zwp_relative_pointer_manager_v1_get_relative_pointer(context->relative_pointer_manager, context->pointer);
+        zwp_relative_pointer_v1_add_listener(context->relative_pointer, &relative_pointer_listener, context);
+    }
+    if(context->input_timestamps_manager == NULL) {
+        return;
+    }
+    if(context->keyboard != NULL && context->keyboard_timestamps == NULL) {
+        context->keyboard_timestamps = zwp_input_timestamps_manager_v1_get_keyboard_timestamps(context->input_timestamps_manager, context->keyboard);
+        zwp_input_timestamps_v1_add_listener(context->keyboard_timestamps, &keyboard_timestamps_listener, context);
+    }
+    if(context->pointer != NULL && context->pointer_timestamps == NULL) {
+        context->pointer_timestamps = zwp_input_timestamps_manager_v1_get_pointer_timestamps(context->input_timestamps_manager, context->pointer);
+        zwp_input_timestamps_v1_add_listener(context->pointer_timestamps, &pointer_timestamps_listener, context);
+    }
+}
+
+static void seat_capabilities(void *data, struct wl_seat *wl_seat, uint32_t capabilities) {
+    wwlContext* context = data;
+
+    if(context->keyboard == NULL) {
+        context->keyboard = wl_seat_get_keyboard(wl_seat);
+        wl_keyboard_add_listener(context->keyboard, &keyboard_listener, context);
+    }
+
+    if(context->pointer == NULL) {
+        context->pointer = wl_seat_get_pointer(wl_seat);
+        wl_pointer_add_listener(context->pointer, &pointer_listener, context);
+    }
+    setup_input_extensions(context);
+}
+
+static void seat_name(void *data, struct wl_seat *wl_seat, const char *name) {
+
+}
+
+static struct wl_seat_listener seat_listener = {
+    seat_capabilities,
+    seat_name
+};
+
+/**
+ * Change the preferred scale of the window. The buffers get the new size with
+ * the next frame. In render thread mode the render thread applies the scale
+ * @window: The window object
+ * @scale: The scale in 1/WWL_SCALE_BASE
+ */
+static void set_scale(wwlWindow* window, int scale) {
+    if(scale <= 0 || scale == window->preferred_scale) {
+        return;
+    }
+    window->preferred_scale = scale;
+    if(window->render_queue != NULL) {
+        atomic_store(&window->scale_mailbox, scale);
+    } else {
+        window->scale = scale;
+        update_render_size(window);
+    }
+    if(window->scale_callback != NULL) {
+        uint64_t start = begin_callback("scale_callback");
+        window->scale_callback(window, (double) scale / WWL_SCALE_BASE);
+        end_callback(window, "scale_callback", start);
+    }
+}
+
+/**
+ * Use the highest scale of the outputs, which show the window. Only used, when
+ * the compositor doesn't send a fractional scale
+ * @window: The window object
+ */
+static void update_output_scale(wwlWindow* window) {
+    if(window->fractional_scale != NULL) {
+        return;
+    }
+    int scale = 0;
+    for(int i = 0; i < window->entered_count; i++) {
+        for(wwlOutput* output = window->context->outputs; output != NULL; output = output->next) {
+            if(output->output == window->entered[i] && output->scale > scale) {
+                scale = output->scale;
+            }
+        }
+    }
+    /* Keep the last scale, when the window isn't shown on any output */
+    if(scale > 0) {
+        set_scale(window, scale * WWL_SCALE_BASE);
+    }
+}
+
+static void surface_enter(void *data, struct wl_surface *wl_surface, struct wl_output *output) {
+    wwlWindow* window = data;
+    if(window->entered_count < WWL_MAX_OUTPUTS) {
+        window->entered[window->entered_count++] = output;
+    }
+    update_output_scale(window);
+}
+
+/**
+ * Forget an output, which doesn't show the window anymore
+ * @window: The window object
+ * @output: The output
+ */
+static void remove_entered(wwlWindow* window, struct wl_output* output) {
+    for(int i = 0; i < window->entered_count; i++) {
+        if(window->entered[i] == output) {
+            window->entered[i] = window->entered[--window->entered_count];
+            break;
+        }
+    }
+}
+
+static void surface_leave(void *data, struct wl_surface *wl_surface, struct wl_output *output) {
+    wwlWindow* window = data;
+    remove_entered(window, output);
+    update_output_scale(window);
+}
+
+static struct wl_surface_listener surface_output_listener = {
+    surface_enter,
+    surface_leave
+};
+
+static void fractional_preferred_scale(void *data, struct wp_fractional_scale_v1 *wp_fractional_scale_v1, uint32_t scale) {
+    wwlWindow* window = data;
+    set_scale(window, scale);
+}
+
+static struct wp_fractional_scale_v1_listener fractional_scale_listener = {
+    fractional_preferred_scale
+};
+
+static void output_geometry(void *data, struct wl_output *wl_output, int32_t x, int32_t y, int32_t physical_width, int32_t physical_height, int32_t subpixel, const char *make, const char *model, int32_t transform) {
+
+}
+
+static void output_mode(void *data, struct wl_output *wl_output, uint32_t flags, int32_t width, int32_t height, int32_t refresh) {
+
+}
+
+static void output_done(void *data, struct wl_output *wl_output) {
+    wwlOutput* output = data;
+    if(output->pending_scale != output->scale) {
+        output->scale = output->pending_scale;
+        for(wwlWindow* window = output->context->windows; window != NULL; window = window->next) {
+            update_output_scale(window);
+        }
+    }
+}
+
+static void output_scale(void *data, struct wl_output *wl_output, int32_t factor) {
+    wwlOutput* output = data;
+    output->pending_scale = factor;
+}
+
+static struct wl_output_listener output_listener = {
+    output_geometry,
+    output_mode,
+    output_done,
+    output_scale
+};
+
+/**
+ * Answer the ping of the compositor, so the windows aren't marked as not
+ * responding
+ */
+static void wm_base_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32_t serial) {
+    xdg_wm_base_pong(xdg_wm_base, serial);
+}
+
+static struct xdg_wm_base_listener wm_base_listener = {
+    wm_base_ping
+};
+
+/**
+ * Get the global objects
+ */
+static void global_listener(void *data, struct wl_registry *wl_registry, uint32_t name, const char *interface, uint32_t version) {
+    wwlContext* context = data;
+    if(strcmp(interface, wl_compositor_interface.name) == 0) {
+        /* Version 4 has the buffer scale without the preferred scale events */
+        context->compositor_version = version < 4 ? version : 4;
+        context->compositor = wl_registry_bind(wl_registry, name, &wl_compositor_interface, context->compositor_version);
+    } else if(strcmp(interface, wl_shm_interface.name) == 0) {
+        context->shm = wl_registry_bind(wl_registry, name, &wl_shm_interface, 1);
+        wl_shm_add_listener(context->shm, &shm_listener, context);
+    } else if(strcmp(interface, xdg_wm_base_interface.name) == 0) {
+        context->wm_base = wl_registry_bind(wl_registry, name, &xdg_wm_base_interface, version < WWL_WM_BASE_VERSION ? version : WWL_WM_BASE_VERSION);
+        xdg_wm_base_add_listener(context->wm_base, &wm_base_listener, context);
+    } else if(strcmp(interface, wl_seat_interface.name) == 0) {
+        context->seat = wl_registry_bind(wl_registry, name, &wl_seat_interface, version < WWL_SEAT_VERSION ? version : WWL_SEAT_VERSION);
+        wl_seat_add_listener(context->seat, &seat_listener, context);
+    } else if(strcmp(interface, wp_presentation_interface.name) == 0) {
+        context->presentation = wl_registry_bind(wl_registry, name, &wp_presentation_interface, 1);
+        wp_presentation_add_listener(context->presentation, &presentation_listener, context);
+    } else if(strcmp(interface, wp_viewporter_interface.name) == 0) {
+        context->viewporter = wl_registry_bind(wl_registry, name, &wp_viewporter_interface, 1);
+    } else if(strcmp(interface, wp_fractional_scale_manager_v1_interface.name) == 0) {
+        context->fractional_scale_manager = wl_registry_bind(wl_registry, name, &wp_fractional_scale_manager_v1_interface, 1);
+    } else if(strcmp(interface, wp_single_pixel_buffer_manager_v1_interface.name) == 0) {
+        context->single_pixel_manager = wl_registry_bind(wl_registry, name, &wp_single_pixel_buffer_manager_v1_interface, 1);
+    } else if(strcmp(interface, wl_subcompositor_interface.name) == 0) {
+        context->subcompositor = wl_registry_bind(wl_registry, name, &wl_subcompositor_interface, 1);
+    } else if(strcmp(interface, zwp_relative_pointer_manager_v1_interface.name) == 0) {
+        context->relative_pointer_manager = wl_registry_bind(wl_registry, name, &zwp_relative_pointer_manager_v1_interface, 1);
+        setup_input_extensions(context);
+    } else if(strcmp(interface, zwp_input_timestamps_manager_v1_interface.name) == 0) {
+        context->input_timestamps_manager = wl_registry_bind(wl_registry, name, &zwp_input_timestamps_manager_v1_interface, 1);
+        setup_input_extensions(context);
+    } else if(strcmp(interface, wl_output_interface.name) == 0) {
+        wwlOutput* output = calloc(1, sizeof(wwlOutput));
+        output->context = context;
+        output->name = name;
+        output->scale = 1;
+        output->pending_scale = 1;
+        /* The scale event has been added in version 2 */
+        output->output = wl_registry_bind(wl_registry, name, &wl_output_interface, version < 2 ? version : 2);
+        wl_output_add_listener(output->output, &output_listener, output);
+        output->next = context->outputs;
+        context->outputs = output;
+    }
+}
+
+static void global_remove(void *data, struct wl_registry *wl_registry, uint32_t name) {
+    wwlContext* context = data;
+    for(wwlOutput** link = &context->outputs; *link != NULL; link = &(*link)->next) {
+        wwlOutput* output = *link;
+        if(output->name == name) {
+            *link = output->next;
+            for(wwlWindow* window = context->windows; window != NULL; window = window->next) {
+                remove_entered(window, output->output);
+                update_output_scale(window);
+            }
+            wl_output_destroy(output->output);
+            free(output);
+            break;
+        }
+    }
+}
+
+static struct wl_registry_listener listener = {
+    global_listener,
+    global_remove
+};
+
+/**
+ * Apply the deferred configuration. It gets acknowledged with the commit of the
+ * next frame
+ * @window: The window object
+ */
+static void apply_configure(wwlWindow* window) {
+    window->resize_pending = 0;
+    window->surface_width = window->deferred.width;
+    window->surface_height = window->deferred.height;
+    window->configure_serial = window->deferred.serial;
+    window->needs_ack = 1;
+    window->configured = 1;
+    update_render_size(window);
+    notify_resize(window);
+}
+
+/**
+ * Change the state of the window and tell the application about it
+ * @window: The window object
+ * @state: The new wwlWindowState flags
+ */
+static void set_state(wwlWindow* window, int state) {
+    if(state == window->state) {
+        return;
+    }
+    window->state = state;
+    if(window->state_callback != NULL) {
+        uint64_t start = begin_callback("state_callback");
+        window->state_callback(window, state);
+        end_callback(window, "state_callback", start);
+    }
+}
+
+/**
+ * Honestly. I don't really know what's up with this function. I have to have it
+ * and I have to create and attach a buffer, even if I don't want to.
+ *
+ * During an interactive resize the compositor sends many configurations per
+ * frame. Only the latest one is applied with the next frame callback, so there
+ * is at most one new buffer size per frame
+ */
+static void surface_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial) {
+    wwlWindow* window = data;
+    set_state(window, window->pending_state | (window->state & WWL_STATE_HIDDEN));
+    if(window->render_queue != NULL) {
+        publish_configure(window, serial);
+        return;
+    }
+    window->deferred.serial = serial;
+    window->deferred.width = window->pending_width;
+    window->deferred.height = window->pending_height;
+    if(window->configured && window->pending_frame != NULL) {
+        window->resize_pending = 1;
+        return;
+    }
+    apply_configure(window);
+    present(window);
+}
+
+static struct xdg_surface_listener surface_listener = {
+    surface_configure
+};
+
+/**
+ * Gets called when the size of the window changes
+ */
+static void toplevel_configure(void *data, struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height, struct wl_array *states) {
+    wwlWindow* window = data;
+    if(width != 0 && height != 0) {
+        window->pending_width = width;
+        window->pending_height = height;
+    }
+    /* The states of xdg_toplevel are numbered from 1 in the same order as the
+    flags of wwlWindowState */
+    window->pending_state = 0;
+    uint32_t* state;
+    wl_array_for_each(state, states) {
+        if(*state >= XDG_TOPLEVEL_STATE_MAXIMIZED && *state <= XDG_TOPLEVEL_STATE_SUSPENDED) {
+            window->pending_state |= 1 << (*state - 1);
+        }
+    }
+}
+
+/**
+ * Gets called when the window should be closed
+ */
+static void toplevel_close(void *data, struct xdg_toplevel *xdg_toplevel) {
+    wwlWindow* window = data;
+    window->running = 0;
+    /* wwlWaitFrame() returns, when the window should be closed */
+    if(window->render_queue != NULL) {
+        wake_render_thread(window);
+    }
+}
+
+static void toplevel_configure_bounds(void *data, struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height) {
+}
+
+static void toplevel_wm_capabilities(void *data, struct xdg_toplevel *xdg_toplevel, struct wl_array *capabilities) {
+}
+
+static struct xdg_toplevel_listener toplevel_listener = {
+    toplevel_configure,
+    toplevel_close,
+    toplevel_configure_bounds,
+    toplevel_wm_capabilities
+};
+
+static void frame_done(void *data, struct wl_callback *wl_callback, uint32_t callback_data) {
+    wwlWindow* window = data;
+    
+    wl_callback_destroy(wl_callback);
+    window->pending_frame = NULL;
+    /* A slow frame callback doesn't make the window visible again */
+    if((window->state & WWL_STATE_HIDDEN) && get_time() - window->frame_requested < WWL_HIDDEN_TIMEOUT) {
+        set_state(window, window->state & ~WWL_STATE_HIDDEN);
+    }
+
+    if(window->resize_pending) {
+        apply_configure(window);
+    }
+    notify_resize(window);
+    /* The frame drawn in the callback gets presented right away */
+    if(window->frame_callback != NULL) {
+        uint64_t start = begin_callback("frame_callback");
+        window->frame_callback(window, callback_data);
+        end_callback(window, "frame_callback", start);
+    }
+    /* A configuration, which only changed the state, has to be acknowledged with
+    a commit as well */
+    if(window->damaged || window->needs_ack) {
+        present(window);
+    }
+    /* Find out with an empty commit, whether the window is visible again */
+    if((window->state & WWL_STATE_HIDDEN) && window->pending_frame == NULL && !in_frame(window)) {
+        request_frame(window);
+        wl_surface_commit(window->surface);
+    }
+}
+
+static struct wl_callback_listener frame_listener = {
+    frame_done
+};
+
+/**
+ * Present the damaged frames of all windows, which have no pending frame
+ * callback. Without a pending frame callback, nothing else would present them
+ * @context: The context
+ */
+static void flush_frames(wwlContext* context) {
+    for(wwlWindow* window = context->windows; window != NULL; window = window->next) {
+        if(window->resize_pending && get_time() - window->frame_requested > WWL_CONFIGURE_TIMEOUT) {
+            apply_configure(window);
+            present(window);
+            continue;
+        }
+        /* In render thread mode only the render thread presents */
+        if(window->render_queue == NULL && window->configured && window->damaged && window->pending_frame == NULL) {
+            notify_resize(window);
+            present(window);
+        }
+        /* The compositor doesn't show the last frame */
+        if(window->render_queue == NULL && window->parent == NULL && window->pending_frame != NULL && !(window->state & WWL_STATE_HIDDEN)
+                && get_time() - window->frame_requested > WWL_HIDDEN_TIMEOUT) {
+            set_state(window, window->state | WWL_STATE_HIDDEN);
+        }
+        /* Apply the positions, the order and the synchronized frames of the
+        layers. The layers come before their window in the list. The render
+        thread commits its window itself */
+        if(window->render_queue == NULL) {
+            commit_changes(window);
+        }
+    }
+}
+
+/**
+ * Handle the queued events, send the pending requests and prepare reading from
+ * the connection. Returns -1 on error
+ * @context: The context
+ */
+static int prepare_read(wwlContext* context) {
+    flush_frames(context);
+    while(wl_display_prepare_read(context->display) != 0) {
+        if(dispatch_queue(context, NULL, 0, &context->dispatch_time) == -1) {
+            return -1;
+        }
+    }
+    /* When the socket is full, the rest is sent with the next flush */
+    if(wl_display_flush(context->display) == -1 && errno != EAGAIN) {
+        wl_display_cancel_read(context->display);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Finish a prepared read and handle the events. Returns -1 on error
+ * @context: The context
+ * @readable: True, when the connection is readable
+ */
+static int dispatch_events(wwlContext* context, int readable) {
+    if(readable) {
+        if(wl_display_read_events(context->display) == -1) {
+            return -1;
+        }
+    } else {
+        wl_display_cancel_read(context->display);
+    }
+    return dispatch_queue(context, NULL, 0, &context->dispatch_time);
+}
+
+/**
+ * Wait at most timeout milliseconds for events and handle them. Returns -1 on
+ * error
+ * @context: The context
+ * @timeout: The maximum time to wait in milliseconds. -1 waits forever
+ */
+static int wait_events(wwlContext* context, int timeout) {
+    if(prepare_read(context) == -1) {
+        return -1;
+    }
+    struct pollfd fd = { wl_display_get_fd(context->display), POLLIN, 0 };
+    int ret;
+    do {
+        ret = poll(&fd, 1, timeout);
+    } while(ret == -1 && errno == EINTR);
+    if(ret == -1) {
+        wl_display_cancel_read(context->display);
+        return -1;
+    }
+    return dispatch_events(context, ret > 0);
+}
+
+/**
+ * Destroys the globals of the context and closes the connection
+ * @context: The context
+ */
+static void destroy_context(wwlContext* context) {
+    if(context->relative_pointer != NULL) {
+        zwp_relative_pointer_v1_destroy(context->relative_pointer);
+    }
+    if(context->keyboard_timestamps != NULL) {
+        zwp_input_timestamps_v1_destroy(context->keyboard_timestamps);
+    }
+    if(context->pointer_timestamps != NULL) {
+        zwp_input_timestamps_v1_destroy(context->pointer_timestamps);
+    }
+    if(context->relative_pointer_manager != NULL) {
+        zwp_relative_pointer_manager_v1_destroy(context->relative_pointer_manager);
+    }
+    if(context->input_timestamps_manager != NULL) {
+        zwp_input_timestamps_manager_v1_destroy(context->input_timestamps_manager);
+    }
+    if(context->keyboard != NULL) {
+        wl_keyboard_destroy(context->keyboard);
+    }
+    if(context->pointer != NULL) {
+        wl_pointer_destroy(context->pointer);
+    }
+    if(context->seat != NULL) {
+        wl_seat_destroy(context->seat);
+    }
+    if(context->presentation != NULL) {
+        wp_presentation_destroy(context->presentation);
+    }
+    if(context->viewporter != NULL) {
+        wp_viewporter_destroy(context->viewporter);
+    }
+    if(context->fractional_scale_manager != NULL) {
+        wp_fractional_scale_manager_v1_destroy(context->fractional_scale_manager);
+    }
+    if(context->single_pixel_manager != NULL) {
+        wp_single_pixel_buffer_manager_v1_destroy(context->single_pixel_manager);
+    }
+    if(context->subcompositor != NULL) {
+        wl_subcompositor_destroy(context->subcompositor);
+    }
+    while(context->outputs != NULL) {
+        wwlOutput* output = context->outputs;
+        context->outputs = output->next;
+        wl_output_destroy(output->output);
+        free(output);
+    }
+    if(context->wm_base != NULL) {
+        xdg_wm_base_destroy(context->wm_base);
+    }
+    if(context->shm != NULL) {
+        wl_shm_destroy(context->shm);
+    }
+    if(context->compositor != NULL) {
+        wl_compositor_destroy(context->compositor);
+    }
+    wl_registry_destroy(context->registry);
+    xkb_state_unref(context->keyboard_state);
+    xkb_keymap_unref(context->keyboard_keymap);
+    xkb_context_unref(context->keyboard_context);
+    wl_display_disconnect(context->display);
+    free(context);
+}
+
+/**
+ * Create a window object with a surface, which isn't shown yet, and add it to
+ * the context
+ * @context: The context
+ * @width: The width of the surface
+ * @height: The height of the surface
+ */
+static wwlWindow* create_window(wwlContext* context, int width, int height) {
+    wwlWindow* window = calloc(1, sizeof(wwlWindow));
+    window->context = context;
+    window->width = width;
+    window->height = height;
+    window->surface_width = width;
+    window->surface_height = height;
+    window->viewport_width = -1;
+    window->viewport_height = -1;
+    window->scale = WWL_SCALE_BASE;
+    window->preferred_scale = WWL_SCALE_BASE;
+    /* The first frame is black, until something is drawn */
+    window->clear_color = 0xFF000000;
+    window->solid = 1;
+    window->buffer_scale = 1;
+    window->pending_width = width;
+    window->pending_height = height;
+    window->running = 1;
+    window->pool_fd = -1;
+    window->memory_flags = WWL_MEMORY_PREFAULT;
+    window->hidden_interval = WWL_HIDDEN_INTERVAL;
+    pthread_mutex_init(&window->stats_lock, NULL);
+    window->configure_write = 0;
+    atomic_init(&window->configure_mailbox, 1);
+    window->configure_read = 2;
+
+    window->surface = wl_compositor_create_surface(context->compositor);
+    wl_surface_add_listener(window->surface, &surface_output_listener, window);
+    if(context->viewporter != NULL) {
+        window->viewport = wp_viewporter_get_viewport(context->viewporter, window->surface);
+    }
+    /* Fractional scales can only be shown with a viewport */
+    if(context->viewporter != NULL && context->fractional_scale_manager != NULL) {
+        window->fractional_scale = wp_fractional_scale_manager_v1_get_fractional_scale(context->fractional_scale_manager, window->surface);
+        wp_fractional_scale_v1_add_listener(window->fractional_scale, &fractional_scale_listener, window);
+    }
+
+    window->render_display = context->display;
+    window->render_surface = window->surface;
+    window->render_shm = context->shm;
+    window->render_presentation = context->presentation;
+    window->render_single_pixel = context->single_pixel_manager;
+
+    window->next = context->windows;
+    context->windows = window;
+
+    return window;
+}
+
+/**
+ * ==================================
+ * API Section
+ * ==================================
+ */
+wwlContext* wwlCreateContext(void) {
+    wwlContext* context = calloc(1, sizeof(wwlContext));
+    /* Every compositor has to support these formats */
+    context->supported_formats = 1 << WWL_FORMAT_XRGB8888 | 1 << WWL_FORMAT_ARGB8888;
+    context->presentation_clock = CLOCK_MONOTONIC;
+
+    select_kernels();
+
+    context->display = wl_display_connect(NULL);
+    if(context->display == NULL) {
+        fprintf(stderr, "Couldn't find wayland display\n");
+        free(context);
+        return NULL;
+    }
+
+    context->registry = wl_display_get_registry(context->display);
+    wl_registry_add_listener(context->registry, &listener, context);
+    wl_display_roundtrip(context->display);
+    /* Receive the formats of the shared memory */
+    wl_display_roundtrip(context->display);
+
+    context->keyboard_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+
+    return context;
+}
+
+wwlWindow* wwlCreateContextWindow(wwlContext* context, int width, int height, const char* title) {
+    wwlWindow* window = create_window(context, width, height);
+    window->xdg_surface = xdg_wm_base_get_xdg_surface(context->wm_base, window->surface);
+    window->toplevel = xdg_surface_get_toplevel(window->xdg_surface);
+    xdg_surface_add_listener(window->xdg_surface, &surface_listener, window);
+    xdg_toplevel_add_listener(window->toplevel, &toplevel_listener, window);
+    xdg_toplevel_set_title(window->toplevel, title);
+    wl_surface_commit(window->surface);
+    return window;
+}
+
+wwlWindow* wwlCreateWindow(int width, int height, const char* title) {
+    wwlContext* context = wwlCreateContext();
+    if(context == NULL) {
+        return NULL;
+    }
+    wwlWindow* window = wwlCreateContextWindow(context, width, height, title);
+    window->owns_context = 1;
+    return window;
+}
+
+int wwlDispatchContext(wwlContext* context, int timeout) {
+    return wait_events(context, timeout) == -1 ? -1 : 0;
+}
+
+int wwlIsCloseRequested(wwlWindow* window) {
+    return !window->running;
+}
+
+int wwlShouldClose(wwlWindow* window) {
+    flush_frames(window->context);
+    return dispatch_queue(window->context, NULL, 1, &window->context->dispatch_time) == -1 || !window->running;
+}
+
+int wwlGetFd(wwlWindow* window) {
+    return wl_display_get_fd(window->context->display);
+}
+
+int wwlPrepareRead(wwlWindow* window) {
+    return prepare_read(window->context);
+}
+
+int wwlDispatchEvents(wwlWindow* window, int readable) {
+    return dispatch_events(window->context, readable) == -1 || !window->running;
+}
+
+int wwlWaitEventsTimeout(wwlWindow* window, int timeout) {
+    return wait_events(window->context, timeout) == -1 || !window->running;
+}
+
+int wwlPollEvents(wwlWindow* window) {
+    return wwlWaitEventsTimeout(window, 0);
+}
+
+int wwlPollEventsThrottled(wwlWindow* window) {
+    int timeout = 0;
+    if(window->hidden_interval > 0 && (window->state & (WWL_STATE_SUSPENDED | WWL_STATE_HIDDEN))) {
+        /* Nobody sees the frames, so the loop of the application runs slower */
+        uint64_t next = window->last_poll + (uint64_t)window->hidden_interval * 1000000;
+        uint64_t now = get_time();
+        timeout = next > now ? (next - now + 999999) / 1000000 : 0;
+    }
+    int ret = wwlWaitEventsTimeout(window, timeout);
+    window->last_poll = get_time();
+    return ret;
+}
+
+void wwlSetHiddenInterval(wwlWindow* window, int interval) {
+    window->hidden_interval = interval > 0 ? interval : 0;
+}
+
+void wwlGetDimensions(wwlWindow* window, int* width, int* height) {
+    *width = window->width;
+    *height = window->height;
+}
+
+void wwlGetSurfaceSize(wwlWindow* window, int* width, int* height) {
+    *width = window->surface_width;
+    *height = window->surface_height;
+}
+
+double wwlGetScale(wwlWindow* window) {
+    return (double) window->scale / WWL_SCALE_BASE;
+}
+
+void wwlSetScaleCallback(wwlWindow* window, void (*scale_callback)(void* window, double scale)) {
+    window->scale_callback = scale_callback;
+}
+
+void wwlSetResizeCallback(wwlWindow* window, void (*resize_callback)(void* window, int width, int height)) {
+    window->resize_callback = resize_callback;
+}
+
+int wwlGetWindowState(wwlWindow* window) {
+    return window->state;
+}
+
+void wwlSetStateCallback(wwlWindow* window, void (*state_callback)(void* window, int state)) {
+    window->state_callback = state_callback;
+}
+
+int wwlSetRenderSize(wwlWindow* window, int width, int height) {
+    if(window->viewport == NULL && width > 0) {
+        fprintf(stderr, "The compositor doesn't support wp_viewporter\n");
+        return -1;
+    }
+    window->render_width = width > 0 && height > 0 ? width : 0;
+    window->render_height = width > 0 && height > 0 ? height : 0;
+    window->render_scale = 0;
+    update_render_size(window);
+    return 0;
+}
+
+int wwlSetRenderScale(wwlWindow* window, double scale) {
+    if(window->viewport == NULL && scale > 0 && scale != 1) {
+        fprintf(stderr, "The compositor doesn't support wp_viewporter\n");
+        return -1;
+    }
+    window->render_width = 0;
+    window->render_height = 0;
+    window->render_scale = scale > 0 ? scale : 0;
+    update_render_size(window);
+    return 0;
+}
+
+int wwlDraw(wwlWindow* window, uint32_t* content, int size) {
+    take_configure(window);
+    if(window->width * window->height * formats[window->format].bpp != size) {
+        fprintf(stderr, "Size doesn't match\n");
+        return -1;
+    }
+    window->content = content;
+    window->content_width = window->width;
+    window->content_height = window->height;
+    window->yuv = 0;
+
+    struct wwlBuffer* front = window->front;
+    /* The front buffer contains, what is on screen right now */
+    int on_screen = front != NULL && front->width == window->width && front->height == window->height && front->format == formats[window->format].shm_format && front->stride == window->width * 4;
+    if(window->auto_damage && on_screen) {
+        window->solid = 0;
+        diff_frame(window, content, buffer_data(window, front));
+        window->damaged = window->damage_count > 0;
+        /* Only a frame, which differs everywhere, can have become a single color */
+        wwlRect* rect = &window->damage[0];
+        if(window->damage_count != 1 || rect->width != window->width || rect->height != window->height) {
+            return 0;
+        }
+    }
+
+    /* The single color check only runs for the first frame, after wwlClear()
+    and for frames, which changed completely */
+    const struct wwlFormatInfo* info = &formats[window->format];
+    if(window->viewport != NULL && info->bpp == 4 && (!on_screen || window->auto_damage) && is_uniform(content, window->width, window->height)) {
+        uint32_t color;
+        shuffle(&color, content, 1, info->order);
+        if(info->fallback == WL_SHM_FORMAT_XRGB8888) {
+            color |= 0xFF000000;
+        }
+        /* The same color is already on screen */
+        if(window->solid && front == NULL && window->clear_color == color) {
+            return 0;
+        }
+        window->clear_color = color;
+        window->solid = 1;
+    } else {
+        window->solid = 0;
+    }
+    window->damage[0] = (wwlRect){ 0, 0, window->width, window->height };
+    window->damage_count = 1;
+    window->damaged = 1;
+    return 0;
+}
+
+int wwlDrawRegions(wwlWindow* window, uint32_t* content, const wwlRect* rects, int count) {
+    take_configure(window);
+    if(content != window->content || window->content_width != window->width || window->content_height != window->height) {
+        /* The rest of the frame is new as well */
+        return wwlDraw(window, content, window->width * window->height * formats[window->format].bpp);
+    }
+    for(int i = 0; i < count; i++) {
+        wwlRect rect = rects[i];
+        if(rect_clip(&rect, window->width, window->height)) {
+            add_damage(window->damage, &window->damage_count, rect);
+            window->damaged = 1;
+            window->solid = 0;
+        }
+    }
+    return 0;
+}
+
+int wwlDrawRegion(wwlWindow* window, uint32_t* content, int x, int y, int width, int height) {
+    wwlRect rect = { x, y, width, height };
+    return wwlDrawRegions(window, content, &rect, 1);
+}
+
+int wwlDrawYUV(wwlWindow* window, enum wwlYUVFormat format, int width, int height, const uint8_t* const planes[3], const int strides[3]) {
+    take_configure(window);
+    if(format < 0 || format >= (int)WWL_YUV_FORMAT_COUNT || width <= 0 || height <= 0) {
+        fprintf(stderr, "Invalid video frame\n");
+        return -1;
+    }
+    /* The chroma covers two pixels in a row and with 4:2:0 also two rows */
+    if(width % 2 != 0 || (format != WWL_YUV_YUYV && height % 2 != 0)) {
+        fprintf(stderr, "The video frame has an odd size\n");
+        return -1;
+    }
+    if(window->viewport == NULL && (width != window->width || height != window->height)) {
+        fprintf(stderr, "Size doesn't match\n");
+        return -1;
+    }
+    window->content = NULL;
+    window->yuv = 1;
+    window->yuv_format = format;
+    window->yuv_width = width;
+    window->yuv_height = height;
+    for(int i = 0; i < 3; i++) {
+        window->yuv_planes[i] = planes[i];
+        window->yuv_strides[i] = strides[i];
+    }
+    window->solid = 0;
+    window->damage[0] = (wwlRect){ 0, 0, width, height };
+    window->damage_count = 1;
+    window->damaged = 1;
+    return 0;
+}
+
+int wwlIsYUVFormatSupported(wwlWindow* window, enum wwlYUVFormat format) {
+    return format >= 0 && format < (int)WWL_YUV_FORMAT_COUNT && (window->context->supported_yuv & (1 << format)) != 0;
+}
+
+void wwlClear(wwlWindow* window, uint32_t color) {
+    /* The content of the last draw call is outdated now */
+    window->content = NULL;
+    window->yuv = 0;
+    window->clear_color = color;
+    window->solid = 1;
+    window->damage[0] = (wwlRect){ 0, 0, window->width, window->height };
+    window->damage_count = 1;
+    window->damaged = 1;
+}
+
+int wwlAcquireBuffer(wwlWindow* window, uint32_t** pixels, int* stride) {
+    struct wwlBuffer* buffer = back_buffer(window);
+    if(buffer == NULL) {
+        return -1;
+    }
+    *pixels = buffer_data(window, buffer);
+    *stride = buffer->stride;
+    return buffer->age;
+}
+
+int wwlPresentRegions(wwlWindow* window, const wwlRect* rects, int count) {
+    struct wwlBuffer* buffer = window->acquired;
+    if(buffer == NULL) {
+        fprintf(stderr, "No buffer has been acquired\n");
+        return -1;
+    }
+    window->acquired = NULL;
+    release_acquired_pool(window);
+
+    /* The content of the last draw call is outdated now. The damage of the raster
+    functions is kept */
+    window->content = NULL;
+    for(int i = 0; i < count; i++) {
+        wwlRect rect = rects[i];
+        if(rect_clip(&rect, buffer->width, buffer->height)) {
+            add_damage(window->damage, &window->damage_count, rect);
+        }
+    }
+    commit_buffer(window, buffer);
+    return 0;
+}
+
+int wwlPresent(wwlWindow* window) {
+    wwlRect rect = { 0, 0, INT32_MAX, INT32_MAX };
+    return wwlPresentRegions(window, &rect, 1);
+}
+
+int wwlFillRect(wwlWindow* window, const wwlRect* rect, uint32_t color) {
+    struct wwlBuffer* buffer = raster_buffer(window);
+    if(buffer == NULL) {
+        return -1;
+    }
+    wwlRect clipped = *rect;
+    if(!rect_clip(&clipped, buffer->width, buffer->height)) {
+        return 0;
+    }
+    uint8_t* data = buffer_data(window, buffer);
+    int bpp = format_bpp(buffer->format);
+    for(int y = clipped.y; y < clipped.y + clipped.height; y++) {
+        uint8_t* row = data + y * buffer->stride + clipped.x * bpp;
+        if(bpp == 2) {
+            for(int x = 0; x < clipped.width; x++) {
+                ((uint16_t*)row)[x] = color;
+            }
+        } else {
+            fill_span((uint32_t*)row, color, clipped.width);
+        }
+    }
+    add_damage(window->damage, &window->damage_count, clipped);
+    return 0;
+}
+
+int wwlBlit(wwlWindow* window, int x, int y, const void* pixels, int stride, int width, int height) {
+    struct wwlBuffer* buffer = raster_buffer(window);
+    if(buffer == NULL) {
+        return -1;
+    }
+    wwlRect rect = { x, y, width, height };
+    int src_x, src_y;
+    if(!clip_source(buffer, &rect, &src_x, &src_y)) {
+        return 0;
+    }
+    int bpp = format_bpp(buffer->format);
+    uint8_t* dst = (uint8_t*)buffer_data(window, buffer) + rect.y * buffer->stride + rect.x * bpp;
+    const uint8_t* src = (const uint8_t*)pixels + src_y * stride + src_x * bpp;
+    for(int row = 0; row < rect.height; row++) {
+        memcpy(dst + row * buffer->stride, src + row * stride, rect.width * bpp);
+    }
+    add_damage(window->damage, &window->damage_count, rect);
+    return 0;
+}
+
+int wwlBlendOver(wwlWindow* window, int x, int y, const uint32_t* pixels, int stride, int width, int height) {
+    struct wwlBuffer* buffer = raster_buffer(window);
+    if(buffer == NULL) {
+        return -1;
+    }
+    if(buffer->format != WL_SHM_FORMAT_XRGB8888 && buffer->format != WL_SHM_FORMAT_ARGB8888 && buffer->format != WL_SHM_FORMAT_XBGR8888 && buffer->format != WL_SHM_FORMAT_ABGR8888) {
+        fprintf(stderr, "Blending needs the alpha in the highest byte of a pixel\n");
+        return -1;
+    }
+    wwlRect rect = { x, y, width, height };
+    int src_x, src_y;
+    if(!clip_source(buffer, &rect, &src_x, &src_y)) {
+        return 0;
+    }
+    uint8_t* dst = (uint8_t*)buffer_data(window, buffer) + rect.y * buffer->stride + rect.x * 4;
+    const uint8_t* src = (const uint8_t*)pixels + src_y * stride + src_x * 4;
+    for(int row = 0; row < rect.height; row++) {
+        blend_span((uint32_t*)(dst + row * buffer->stride), (const uint32_t*)(src + row * stride), rect.width);
+    }
+    add_damage(window->damage, &window->damage_count, rect);
+    return 0;
+}
+
+int wwlScrollRegion(wwlWindow* window, const wwlRect* rect, int dx, int dy) {
+    struct wwlBuffer* buffer = raster_buffer(window);
+    if(buffer == NULL) {
+        return -1;
+    }
+    wwlRect region = *rect;
+    if(!rect_clip(&region, buffer->width, buffer->height)) {
+        return 0;
+    }
+    /* The pixels, which stay inside of the region after moving */
+    wwlRect moved = { region.x + (dx > 0 ? dx : 0), region.y + (dy > 0 ? dy : 0), region.width - abs(dx), region.height - abs(dy) };
+    if(moved.width <= 0 || moved.height <= 0) {
+        return 0;
+    }
+    int bpp = format_bpp(buffer->format);
+    uint8_t* data = buffer_data(window, buffer);
+    size_t size = (size_t)moved.width * bpp;
+    /* Copy the rows in the direction of the movement, so no row is overwritten
+    before it has been moved */
+    for(int i = 0; i < moved.height; i++) {
+        int row = dy > 0 ? moved.height - 1 - i : i;
+        uint8_t* dst = data + (moved.y + row) * buffer->stride + moved.x * bpp;
+        memmove(dst, dst - dy * buffer->stride - dx * bpp, size);
+    }
+    add_damage(window->damage, &window->damage_count, moved);
+    return 0;
+}
+
+int wwlSetPixelFormat(wwlWindow* window, enum wwlPixelFormat format) {
+    if(format < 0 || format >= (int)WWL_FORMAT_COUNT) {
+        fprintf(stderr, "Unknown pixel format\n");
+        return -1;
+    }
+    if(format != window->format) {
+        window->format = format;
+        /* The old content has a different format */
+        window->content = NULL;
+    }
+    return 0;
+}
+
+int wwlIsFormatSupported(wwlWindow* window, enum wwlPixelFormat format) {
+    return format >= 0 && format < (int)WWL_FORMAT_COUNT && (window->context->supported_formats & (1 << format)) != 0;
+}
+
+void wwlSetMemoryFlags(wwlWindow* window, uint32_t flags) {
+    window->memory_flags = flags;
+}
+
+void wwlSetAutoDamage(wwlWindow* window, int enabled) {
+    window->auto_damage = enabled;
+}
+
+void wwlGetDiffStats(wwlWindow* window, wwlDiffStats* stats) {
+    *stats = window->diff_stats;
+}
+
+void wwlGetFrameStats(wwlWindow* window, wwlFrameStats* stats) {
+    pthread_mutex_lock(&window->stats_lock);
+    *stats = window->frame_stats;
+    pthread_mutex_unlock(&window->stats_lock);
+}
+
+void wwlGetStats(wwlWindow* window, wwlStats* stats) {
+    stats->frames = atomic_load(&window->stats.frames);
+    stats->skipped = atomic_load(&window->stats.skipped);
+    stats->bytes_uploaded = atomic_load(&window->stats.bytes_uploaded);
+    stats->shm_allocations = atomic_load(&window->stats.shm_allocations);
+    stats->dispatch_time = atomic_load(&window->context->dispatch_time) + atomic_load(&window->dispatch_time);
+    stats->callback_time = atomic_load(&window->callback_time);
+}
+
+int wwlSetTraceFile(const char* path) {
+    FILE* file = NULL;
+    if(path != NULL) {
+        file = fopen(path, "w");
+        if(file == NULL) {
+            fprintf(stderr, "Couldn't open the trace file\n");
+            return -1;
+        }
+        fputs("[\n", file);
+    }
+    file = atomic_exchange(&trace_file, file);
+    if(file != NULL) {
+        /* The last event has no comma, so the file is valid JSON */
+        fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"wwl\"}}\n]\n", getpid());
+        fclose(file);
+    }
+    return 0;
+}
+
+void wwlSetTitle(wwlWindow* window, const char* title) {
+    xdg_toplevel_set_title(window->toplevel, title);
+    if(in_frame(window) || window->render_queue != NULL) {
+        request_commit(window);
+    } else {
+        wl_surface_commit(window->surface);
+    }
+}
+
+void wwlSetKeyCallback(wwlWindow* window, void (*key_callback)(void* window, char* key, enum wwlKeyAction action)) {
+    window->key_callback = key_callback;
+}
+
+void wwlSetKeySymCallback(wwlWindow* window, void (*keysym_callback)(void* window, uint32_t keycode, uint32_t keysym, uint32_t modifiers, uint32_t time, enum wwlKeyAction action)) {
+    window->keysym_callback = keysym_callback;
+}
+
+int wwlIsKeyDown(wwlWindow* window, uint32_t keysym) {
+    int slot = key_slot(keysym);
+    if(slot == -1) {
+        return 0;
+    }
+    return (window->keys_down[slot / 64] >> (slot % 64)) & 1;
+}
+
+int wwlSetEventQueue(wwlWindow* window, int capacity, int coalesce) {
+    if(capacity < 0) {
+        fprintf(stderr, "Invalid event queue capacity\n");
+        return -1;
+    }
+    wwlEvent* events = NULL;
+    if(capacity > 0) {
+        events = calloc(capacity, sizeof(wwlEvent));
+        if(events == NULL) {
+            fprintf(stderr, "Couldn't allocate the event queue\n");
+            return -1;
+        }
+    }
+    free(window->events);
+    window->events = events;
+    window->event_capacity = capacity;
+    window->event_head = 0;
+    window->event_count = 0;
+    window->coalesce = coalesce;
+    return 0;
+}
+
+int wwlDrainEvents(wwlWindow* window, wwlEvent* events, int max) {
+    int count = window->event_count < max ? window->event_count : max;
+    for(int i = 0; i < count; i++) {
+        events[i] = window->events[window->event_head];
+        window->event_head = (window->event_head + 1) % window->event_capacity;
+    }
+    window->event_count -= count;
+    return count;
+}
+
+void wwlGetEventStats(wwlWindow* window, wwlEventStats* stats) {
+    *stats = window->event_stats;
+}
+
+void wwlGetCursorPos(wwlWindow* window, double* x, double* y) {
+    *x = window->cursor_x;
+    *y = window->cursor_y;
+}
+
+void wwlSetCursorCallback(wwlWindow* window, void (*cursor_callback)(void* window, double x, double y)) {
+    window->cursor_callback = cursor_callback;
+}
+
+void wwlSetMouseButtonCallback(wwlWindow* window, void (*button_callback)(void* window, int button, enum wwlKeyAction action)) {
+    window->button_callback = button_callback;
+}
+
+void wwlSetScrollCallback(wwlWindow* window, void (*scroll_callback)(void* window, double x_offset, double y_offset)) {
+    window->scroll_callback = scroll_callback;
+}
+
+void wwlSetRelativeMotionCallback(wwlWindow* window, void (*relative_callback)(void* window, double dx, double dy, double dx_unaccel, double dy_unaccel)) {
+    window->relative_callback = relative_callback;
+}
+
+uint64_t wwlGetEventTime(wwlWindow* window) {
+    return window->event_time;
+}
+
+void wwlSetInputTracing(wwlWindow* window, int enabled) {
+    window->trace_input = enabled;
+    if(!enabled) {
+        atomic_store(&window->input_time, 0);
+    }
+}
+
+void wwlGetInputLatency(wwlWindow* window, wwlInputLatency* latency) {
+    pthread_mutex_lock(&window->stats_lock);
+    *latency = window->input_latency;
+    pthread_mutex_unlock(&window->stats_lock);
+}
+
+void wwlSetFrameCallback(wwlWindow* window, void (*frame_callback)(void* window, uint32_t time)) {
+    window->frame_callback = frame_callback;
+}
+
+void wwlRequestFrame(wwlWindow* window) {
+    if(window->configured && window->pending_frame == NULL) {
+        request_frame(window);
+        if(in_frame(window)) {
+            window->needs_commit = 1;
+        } else {
+            wl_surface_commit(window->surface);
+        }
+    }
+}
+
+int wwlBeginFrame(wwlWindow* window) {
+    if(window->parent != NULL) {
+        fprintf(stderr, "Layers are part of the frame of their window\n");
+        return -1;
+    }
+    if(window->in_frame) {
+        fprintf(stderr, "The frame has already begun\n");
+        return -1;
+    }
+    window->in_frame = 1;
+    return 0;
+}
+
+/**
+ * Present or commit the changes of a window or a layer at the end of a
+ * transaction. Returns true, when the surface has been committed
+ * @window: The window object
+ */
+static int finish_frame(wwlWindow* window) {
+    uint64_t frames = window->stats.frames;
+    int committed = window->staged;
+    if(window->staged) {
+        commit_frame(window);
+    } else if(window->configured && window->damaged && window->pending_frame == NULL) {
+        present(window);
+        committed = window->stats.frames != frames;
+    }
+    if(window->needs_commit && window->configured) {
+        prepare_commit(window);
+        wl_surface_commit(window->surface);
+        committed = 1;
+    }
+    return committed;
+}
+
+int wwlEndFrame(wwlWindow* window) {
+    if(!window->in_frame) {
+        fprintf(stderr, "No frame has begun\n");
+        return -1;
+    }
+    window->in_frame = 0;
+    trace_begin("end_frame");
+    /* The layers are committed first. Unsynchronized layers are synchronized
+    until the window has been committed, so all changes appear at once */
+    for(wwlWindow* layer = window->context->windows; layer != NULL; layer = layer->next) {
+        if(layer->parent == window) {
+            if(!layer->sync) {
+                wl_subsurface_set_sync(layer->subsurface);
+            }
+            if(finish_frame(layer)) {
+                window->needs_commit = 1;
+            }
+        }
+    }
+    finish_frame(window);
+    for(wwlWindow* layer = window->context->windows; layer != NULL; layer = layer->next) {
+        if(layer->parent == window && !layer->sync) {
+            wl_subsurface_set_desync(layer->subsurface);
+        }
+    }
+    trace_end("end_frame");
+    /* When the socket is full, the rest is sent with the next flush */
+    if(wl_display_flush(window->context->display) == -1 && errno != EAGAIN) {
+        fprintf(stderr, "Couldn't send the frame\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Sets a region of the surface from rectangles in surface coordinates. NULL
+ * resets the region
+ * @window: The window object
+ * @rects: The rectangles or NULL
+ * @count: The number of rectangles
+ * @set_region: The request, which sets the region
+ */
+static void set_region(wwlWindow* window, const wwlRect* rects, int count, void (*set_region)(struct wl_surface*, struct wl_region*)) {
+    struct wl_region* region = NULL;
+    if(rects != NULL) {
+        region = wl_compositor_create_region(window->context->compositor);
+        for(int i = 0; i < count; i++) {
+            wl_region_add(region, rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+        }
+    }
+    set_region(window->surface, region);
+    if(region != NULL) {
+        wl_region_destroy(region);
+    }
+    request_commit(window);
+}
+
+void wwlSetOpaqueRegion(wwlWindow* window, const wwlRect* rects, int count) {
+    set_region(window, rects, count, wl_surface_set_opaque_region);
+}
+
+void wwlSetInputRegion(wwlWindow* window, const wwlRect* rects, int count) {
+    set_region(window, rects, count, wl_surface_set_input_region);
+}
+
+wwlLayer* wwlCreateLayer(wwlWindow* window, int x, int y, int width, int height) {
+    wwlContext* context = window->context;
+    if(context->subcompositor == NULL) {
+        fprintf(stderr, "The compositor doesn't support wl_subcompositor\n");
+        return NULL;
+    }
+    if(window->parent != NULL || window->render_queue != NULL) {
+        fprintf(stderr, "Layers can only be added to windows without a render thread\n");
+        return NULL;
+    }
+    wwlWindow* layer = create_window(context, width, height);
+    layer->parent = window;
+    layer->subsurface = wl_subcompositor_get_subsurface(context->subcompositor, layer->surface, window->surface);
+    wl_subsurface_set_position(layer->subsurface, x, y);
+    wl_subsurface_set_desync(layer->subsurface);
+    /* The input goes through the layer to the window */
+    struct wl_region* region = wl_compositor_create_region(context->compositor);
+    wl_surface_set_input_region(layer->surface, region);
+    wl_region_destroy(region);
+
+    /* Layers aren't configured by the compositor */
+    layer->scale = window->scale;
+    layer->preferred_scale = window->preferred_scale;
+    update_render_size(layer);
+    layer->configured = 1;
+    window->needs_commit = 1;
+    return layer;
+}
+
+void wwlSetLayerPosition(wwlLayer* layer, int x, int y) {
+    wl_subsurface_set_position(layer->subsurface, x, y);
+    layer->parent->needs_commit = 1;
+}
+
+void wwlPlaceLayerAbove(wwlLayer* layer, wwlWindow* sibling) {
+    wl_subsurface_place_above(layer->subsurface, sibling->surface);
+    layer->parent->needs_commit = 1;
+}
+
+void wwlPlaceLayerBelow(wwlLayer* layer, wwlWindow* sibling) {
+    wl_subsurface_place_below(layer->subsurface, sibling->surface);
+    layer->parent->needs_commit = 1;
+}
+
+void wwlSetLayerSync(wwlLayer* layer, int sync) {
+    if(sync) {
+        wl_subsurface_set_sync(layer->subsurface);
+    } else {
+        wl_subsurface_set_desync(layer->subsurface);
+    }
+    layer->sync = sync;
+}
+
+int wwlSetRenderThread(wwlWindow* window) {
+    if(window->render_queue != NULL || window->configured) {
+        fprintf(stderr, "The render thread has to be set before the first event\n");
+        return -1;
+    }
+    for(wwlWindow* layer = window->context->windows; layer != NULL; layer = layer->next) {
+        if(layer->parent == window) {
+            fprintf(stderr, "Windows with layers can't have a render thread\n");
+            return -1;
+        }
+    }
+    window->render_queue = wl_display_create_queue(window->context->display);
+    window->render_display = wl_proxy_create_wrapper(window->context->display);
+    wl_proxy_set_queue((struct wl_proxy*)window->render_display, window->render_queue);
+    window->render_surface = wl_proxy_create_wrapper(window->surface);
+    wl_proxy_set_queue((struct wl_proxy*)window->render_surface, window->render_queue);
+    window->render_shm = wl_proxy_create_wrapper(window->context->shm);
+    wl_proxy_set_queue((struct wl_proxy*)window->render_shm, window->render_queue);
+    if(window->context->presentation != NULL) {
+        window->render_presentation = wl_proxy_create_wrapper(window->context->presentation);
+        wl_proxy_set_queue((struct wl_proxy*)window->render_presentation, window->render_queue);
+    }
+    if(window->context->single_pixel_manager != NULL) {
+        window->render_single_pixel = wl_proxy_create_wrapper(window->context->single_pixel_manager);
+        wl_proxy_set_queue((struct wl_proxy*)window->render_single_pixel, window->render_queue);
+    }
+    return 0;
+}
+
+int wwlWaitFrame(wwlWindow* window) {
+    if(window->render_queue == NULL) {
+        fprintf(stderr, "The window has no render thread\n");
+        return -1;
+    }
+    if(dispatch_render_queue(window, 0) == -1) {
+        return -1;
+    }
+    take_configure(window);
+    if(window->configured && window->damaged && window->pending_frame == NULL) {
+        present(window);
+    }
+    commit_changes(window);
+    while(window->running && (!window->configured || window->pending_frame != NULL)) {
+        if(dispatch_render_queue(window, 1) == -1) {
+            return -1;
+        }
+        take_configure(window);
+        commit_changes(window);
+    }
+    return window->running ? 0 : -1;
+}
+
+void wwlCloseWindow(wwlWindow* window) {
+    wwlContext* context = window->context;
+    /* The layers can't outlive their window */
+    for(wwlWindow* layer = context->windows; layer != NULL;) {
+        if(layer->parent == window) {
+            wwlCloseWindow(layer);
+            layer = context->windows;
+        } else {
+            layer = layer->next;
+        }
+    }
+    window->running = 0;
+    if(window->pending_frame != NULL) {
+        wl_callback_destroy(window->pending_frame);
+    }
+    for(int i = 0; i < WWL_FEEDBACK_COUNT; i++) {
+        if(window->feedbacks[i].feedback != NULL) {
+            wp_presentation_feedback_destroy(window->feedbacks[i].feedback);
+        }
+    }
+    for(int i = 0; i < WWL_BUFFER_COUNT; i++) {
+        if(window->buffers[i].buffer != NULL) {
+            wl_buffer_destroy(window->buffers[i].buffer);
+        }
+    }
+    if(window->solid_buffer != NULL) {
+        wl_buffer_destroy(window->solid_buffer);
+    }
+    if(window->solid_pool != NULL) {
+        wl_shm_pool_destroy(window->solid_pool);
+        munmap(window->solid_pool_data, WWL_SOLID_POOL_SIZE);
+    }
+    free(window->dirty_tiles);
+    free(window->events);
+    if(window->pool != NULL) {
+        wl_shm_pool_destroy(window->pool);
+        munmap(window->pool_data, window->pool_size);
+        release_acquired_pool(window);
+        close(window->pool_fd);
+    }
+    if(window->render_queue != NULL) {
+        wl_proxy_wrapper_destroy(window->render_display);
+        wl_proxy_wrapper_destroy(window->render_surface);
+        wl_proxy_wrapper_destroy(window->render_shm);
+        if(window->render_presentation != NULL) {
+            wl_proxy_wrapper_destroy(window->render_presentation);
+        }
+        if(window->render_single_pixel != NULL) {
+            wl_proxy_wrapper_destroy(window->render_single_pixel);
+        }
+        wl_event_queue_destroy(window->render_queue);
+    }
+    if(window->fractional_scale != NULL) {
+        wp_fractional_scale_v1_destroy(window->fractional_scale);
+    }
+    if(window->viewport != NULL) {
+        wp_viewport_destroy(window->viewport);
+    }
+    if(window->subsurface != NULL) {
+        wl_subsurface_destroy(window->subsurface);
+    } else {
+        xdg_toplevel_destroy(window->toplevel);
+        xdg_surface_destroy(window->xdg_surface);
+    }
     wl_surface_destroy(window->surface);
+
+    for(wwlWindow** link = &context->windows; *link != NULL; link = &(*link)->next) {
+        if(*link == window) {
+            *link = window->next;
+            break;
+        }
+    }
+    if(context->keyboard_focus == window) {
+        context->keyboard_focus = NULL;
+    }
+    if(context->pointer_focus == window) {
+        context->pointer_focus = NULL;
+    }
+    int owns_context = window->owns_context;
+    pthread_mutex_destroy(&window->stats_lock);
     free(window);
-}
\ No newline at end of file
+    if(owns_context) {
+        destroy_context(context);
+    }
+}
+
+void wwlDestroyLayer(wwlLayer* layer) {
+    wwlCloseWindow(layer);
+}
+
+void wwlDestroyContext(wwlContext* context) {
+    while(context->windows != NULL) {
+        /* Avoid destroying the context twice */
+        context->windows->owns_context = 0;
+        wwlCloseWindow(context->windows);
+    }
+    destroy_context(context);
+}
@@ -29,9 +29,136 @@
 #include <inttypes.h>
 
 typedef void wwlWindow;
+typedef void wwlContext;
+typedef void wwlLayer;
+
+typedef struct wwlRect {
+    int x;
+    int y;
+    int width;
+    int height;
+} wwlRect;
+
+/**
+ * Pixel formats of the content. The names describe a pixel as a native endian
+ * integer from the highest to the lowest byte, like the formats of wl_shm. On
+ * little endian machines WWL_FORMAT_ABGR8888 is stored as the bytes R, G, B, A
+ * in memory. Formats with alpha are premultiplied
+ */
+enum wwlPixelFormat {
+    WWL_FORMAT_XRGB8888,
+    WWL_FORMAT_ARGB8888,
+    WWL_FORMAT_XBGR8888,
+    WWL_FORMAT_ABGR8888,
+    WWL_FORMAT_RGBX8888,
+    WWL_FORMAT_RGBA8888,
+    WWL_FORMAT_BGRX8888,
+    WWL_FORMAT_BGRA8888,
+    WWL_FORMAT_RGB565
+};
+
+/**
+ * Formats of video frames for wwlDrawYUV(). The colors are BT.601 with limited
+ * range and the chroma has half the resolution of the luma
+ */
+enum wwlYUVFormat {
+    /* A Y plane and a plane of interleaved U and V with half the height */
+    WWL_YUV_NV12,
+    /* A Y plane and separate U and V planes with half the width and height */
+    WWL_YUV_I420,
+    /* A single plane of Y0 U Y1 V samples for each pair of pixels */
+    WWL_YUV_YUYV
+};
+
+/**
+ * Options for the shared memory of the buffers. See wwlSetMemoryFlags()
+ */
+enum wwlMemoryFlag {
+    /* Fault the pages in, when the memory is allocated, instead of during the
+    first frames */
+    WWL_MEMORY_PREFAULT = 1,
+    /* Ask for transparent huge pages, which need fewer page faults and TLB
+    entries for large windows. Only works, when
+    /sys/kernel/mm/transparent_hugepage/shmem_enabled is advise or always, and
+    is ignored otherwise. The default of most systems is never */
+    WWL_MEMORY_HUGE_PAGES = 2,
+    /* Lock the pages in RAM, so they are never swapped out */
+    WWL_MEMORY_LOCK = 4
+};
+
+/**
+ * States of a window. See wwlGetWindowState()
+ */
+enum wwlWindowState {
+    WWL_STATE_MAXIMIZED = 1 << 0,
+    WWL_STATE_FULLSCREEN = 1 << 1,
+    /* The window is being resized interactively */
+    WWL_STATE_RESIZING = 1 << 2,
+    /* The window has the focus */
+    WWL_STATE_ACTIVATED = 1 << 3,
+    /* The window is tiled and has a neighbour on this side */
+    WWL_STATE_TILED_LEFT = 1 << 4,
+    WWL_STATE_TILED_RIGHT = 1 << 5,
+    WWL_STATE_TILED_TOP = 1 << 6,
+    WWL_STATE_TILED_BOTTOM = 1 << 7,
+    /* The compositor doesn't show the window, e.g. on another workspace or on a
+    locked screen, and won't send frame callbacks */
+    WWL_STATE_SUSPENDED = 1 << 8,
+    /* The compositor hasn't sent the frame callback of the last frame for half a
+    second, so the window is most likely minimized or covered */
+    WWL_STATE_HIDDEN = 1 << 9
+};
+
+/**
+ * Number of buckets of the latency histogram. Each bucket covers one millisecond
+ * and the last bucket contains all higher latencies
+ */
+#define WWL_LATENCY_BUCKETS 32
+
+typedef struct wwlFrameStats {
+    /* The number of frames, which have been shown on screen */
+    uint64_t presented;
+    /* The number of frames, which have been replaced before they were shown */
+    uint64_t dropped;
+    /* The number of frames, which missed the first refresh after their commit */
+    uint64_t late;
+    /* The time between commit and presentation of the last frame in nanoseconds */
+    uint64_t latency;
+    /* The refresh interval of the output in nanoseconds. 0, when unknown */
+    uint64_t refresh;
+    /* The number of frames per millisecond of latency of the last 128 frames */
+    uint32_t histogram[WWL_LATENCY_BUCKETS];
+} wwlFrameStats;
+
+typedef struct wwlStats {
+    /* The number of frames, which have been committed */
+    uint64_t frames;
+    /* The number of frames, which had to wait, because all buffers were busy */
+    uint64_t skipped;
+    /* The number of bytes, which have been copied into the shared memory */
+    uint64_t bytes_uploaded;
+    /* The number of times, the shared memory pool has been created or grown */
+    uint64_t shm_allocations;
+    /* The time in nanoseconds, which the handling of events took, including the
+    callbacks. Contains the events of all windows of the context */
+    uint64_t dispatch_time;
+    /* The time in nanoseconds, which the callbacks of the window took */
+    uint64_t callback_time;
+} wwlStats;
+
+typedef struct wwlDiffStats {
+    /* The time in nanoseconds, which the last comparison took */
+    uint64_t time;
+    /* The number of compared tiles */
+    int tiles;
+    /* The number of tiles, which have changed */
+    int dirty_tiles;
+    /* The number of damaged regions, which were created from the tiles */
+    int rects;
+} wwlDiffStats;
 
 /**
- * Creates and returns a window
+ * Creates and returns a window with its own connection to the compositor
  * @width: The width of the window
  * @height: The height of the window
  * @title: The title of the window
@@ -39,33 +166,212 @@ typedef void wwlWindow;
 wwlWindow* wwlCreateWindow(int width, int height, const char* title);
 
 /**
- * Returns true, when the window should be closed
+ * Connects to the compositor and returns a context, which windows can share.
+ * The windows of a context share the connection, the globals, the input devices
+ * and the keymap. Returns NULL on error
+ */
+wwlContext* wwlCreateContext(void);
+
+/**
+ * Creates and returns a window, which uses the connection of the context
+ * @context: The context
+ * @width: The width of the window
+ * @height: The height of the window
+ * @title: The title of the window
+ */
+wwlWindow* wwlCreateContextWindow(wwlContext* context, int width, int height, const char* title);
+
+/**
+ * Presents the damaged frames of all windows of the context, waits at most
+ * timeout milliseconds for events and handles them. Returns -1, when the
+ * connection has been lost
+ * @context: The context
+ * @timeout: The maximum time to wait in milliseconds. -1 waits forever
+ */
+int wwlDispatchContext(wwlContext* context, int timeout);
+
+/**
+ * Returns true, when the compositor asked to close the window. Doesn't handle
+ * any events
+ * @window: The window object
+ */
+int wwlIsCloseRequested(wwlWindow* window);
+
+/**
+ * Returns true, when the window should be closed. Waits for events from the
+ * compositor and handles them
  * @window: The window object
  */
 int wwlShouldClose(wwlWindow* window);
 
 /**
- * Gets the current width and height of the window
+ * Handles the events, which have already arrived, without waiting. Returns true,
+ * when the window should be closed
+ * @window: The window object
+ */
+int wwlPollEvents(wwlWindow* window);
+
+/**
+ * Handles the events like wwlPollEvents(), but while the window is suspended or
+ * hidden, it waits for events for the rest of the interval from
+ * wwlSetHiddenInterval() since its last call. A render loop, which calls it,
+ * doesn't render frames at full rate, which nobody can see. Loops, which must
+ * never wait, use wwlPollEvents() instead. Returns true, when the window should
+ * be closed
+ * @window: The window object
+ */
+int wwlPollEventsThrottled(wwlWindow* window);
+
+/**
+ * Sets the minimum time between two calls of wwlPollEventsThrottled(), while the
+ * window is suspended or hidden. 100 milliseconds by default and 0 to disable
+ * the throttling
+ * @window: The window object
+ * @interval: The interval in milliseconds
+ */
+void wwlSetHiddenInterval(wwlWindow* window, int interval);
+
+/**
+ * Waits at most timeout milliseconds for events from the compositor and handles
+ * them. Returns true, when the window should be closed
+ * @window: The window object
+ * @timeout: The maximum time to wait in milliseconds. -1 waits forever
+ */
+int wwlWaitEventsTimeout(wwlWindow* window, int timeout);
+
+/**
+ * Returns the file descriptor of the connection to the compositor. It can be
+ * added to poll, epoll or select to integrate the window into an existing event
+ * loop. Call wwlPrepareRead() before waiting on it and wwlDispatchEvents() after
+ * @window: The window object
+ */
+int wwlGetFd(wwlWindow* window);
+
+/**
+ * Handles the queued events, sends the pending requests and prepares reading
+ * from the file descriptor. Every successful call has to be followed by a call
+ * to wwlDispatchEvents(). Returns -1 on error
+ * @window: The window object
+ */
+int wwlPrepareRead(wwlWindow* window);
+
+/**
+ * Reads the events from the file descriptor, if it's readable, and handles them.
+ * Returns true, when the window should be closed
+ * @window: The window object
+ * @readable: True, when the file descriptor is readable. Otherwise the prepared
+ * read is cancelled
+ */
+int wwlDispatchEvents(wwlWindow* window, int readable);
+
+/**
+ * Gets the current width and height of the window in pixels of the content. This
+ * is the size of the window multiplied with the scale of its output, so the
+ * content is shown without resampling. With a render size or scale, this is the
+ * size of the render resolution
  * @window: The window object
  * @width: A pointer, where the width will be written
  * @height: A pointer, where the height will be written
  */
 void wwlGetDimensions(wwlWindow* window, int* width, int* height);
 
+/**
+ * Gets the size of the window in logical pixels. Cursor positions are relative
+ * to this size, even when the content is rendered in a different resolution
+ * @window: The window object
+ * @width: A pointer, where the width will be written
+ * @height: A pointer, where the height will be written
+ */
+void wwlGetSurfaceSize(wwlWindow* window, int* width, int* height);
+
+/**
+ * Returns the scale between the logical pixels of the window and the pixels of
+ * its output, like 1.5 or 2. Uses the fractional scale of the compositor, when
+ * it supports wp_fractional_scale_v1 and wp_viewporter, otherwise the highest
+ * integer scale of the outputs, which show the window
+ * @window: The window object
+ */
+double wwlGetScale(wwlWindow* window);
+
+/**
+ * Sets the callback for when the preferred scale of the window changes. The
+ * next frame has to be drawn in the size from wwlGetDimensions()
+ * @window: The window object
+ * @scale_callback: The callback function, which takes the window object and the new scale
+ */
+void wwlSetScaleCallback(wwlWindow* window, void (*scale_callback)(wwlWindow* window, double scale));
+
+/**
+ * Sets the callback for when the size from wwlGetDimensions() changes. The
+ * configurations of the compositor, new scales and wwlSetRenderSize() are
+ * merged, so the callback gets called at most once per frame with the final
+ * size, right before the frame callback. In render thread mode it's called by
+ * the render thread
+ * @window: The window object
+ * @resize_callback: The callback function, which takes the window object and the new width and height
+ */
+void wwlSetResizeCallback(wwlWindow* window, void (*resize_callback)(wwlWindow* window, int width, int height));
+
+/**
+ * Returns the state of the window, a combination of wwlWindowState. The states
+ * besides WWL_STATE_HIDDEN come from the compositor. WWL_STATE_SUSPENDED needs
+ * xdg_wm_base version 6. Windows with a render thread don't get
+ * WWL_STATE_HIDDEN, because wwlWaitFrame() blocks, while no frames are shown
+ * @window: The window object
+ */
+int wwlGetWindowState(wwlWindow* window);
+
+/**
+ * Sets the callback for when the state of the window changes
+ * @window: The window object
+ * @state_callback: The callback function, which takes the window object and the
+ * new state
+ */
+void wwlSetStateCallback(wwlWindow* window, void (*state_callback)(wwlWindow* window, int state));
+
+/**
+ * Renders the content in a fixed resolution, which the compositor scales to the
+ * size of the window. The aspect ratio isn't preserved. A width or height of 0
+ * renders in the size of the window again. Can be changed between frames, the
+ * next frame has to be drawn in the size from wwlGetDimensions(). Returns -1,
+ * when the compositor doesn't support wp_viewporter
+ * @window: The window object
+ * @width: The width of the content
+ * @height: The height of the content
+ */
+int wwlSetRenderSize(wwlWindow* window, int width, int height);
+
+/**
+ * Renders the content in the native size of the window multiplied with the
+ * scale, which the compositor scales to the size of the window. A scale of 0.5
+ * copies a quarter of the pixels. A scale of 0 or 1 renders in the native size
+ * again. Can be changed between frames, the next frame has to be drawn in the
+ * size from wwlGetDimensions(). Returns -1, when the compositor doesn't support
+ * wp_viewporter
+ * @window: The window object
+ * @scale: The scale of the content
+ */
+int wwlSetRenderScale(wwlWindow* window, double scale);
+
 /**
  * Draws the content to the screen
  * @window: The window object
  * @content: An array, which represents the pixel colors. A Pixel has the format
- * XRGB
- * @size: The size of the content array. This should be width * height * 4
+ * XRGB, unless another format has been set with wwlSetPixelFormat()
+ * @size: The size of the content array in bytes. This should be
+ * width * height * 4, or width * height * 2 for 16 bit formats
  */
 int wwlDraw(wwlWindow* window, uint32_t* content, int size);
 
 /**
- * Redraw only a specific region on screen
+ * Redraw only a specific region on screen. Only the pixels inside the region
+ * are copied and only the region is damaged. When content isn't the array of
+ * the last draw call, or the window has been resized since then, the call
+ * silently falls back to wwlDraw() and the whole window is copied and damaged.
+ * So the same array should be reused for partial redraws
  * @window: The window object
- * @content: An array, which represents the pixel colors. A Pixel has the format
- * XRGB
+ * @content: An array, which represents the pixel colors of the whole window in
+ * the same format and size as the content of wwlDraw()
  * @x: The top left x position of the region
  * @y: The top left y position of the region
  * @width: The width of the region
@@ -73,6 +379,217 @@ int wwlDraw(wwlWindow* window, uint32_t* content, int size);
  */
 int wwlDrawRegion(wwlWindow* window, uint32_t* content, int x, int y, int width, int height);
 
+/**
+ * Redraw multiple regions on screen at once. See wwlDrawRegion()
+ * @window: The window object
+ * @content: An array, which represents the pixel colors of the whole window in
+ * the same format and size as the content of wwlDraw()
+ * @rects: The regions, which have changed
+ * @count: The number of regions
+ */
+int wwlDrawRegions(wwlWindow* window, uint32_t* content, const wwlRect* rects, int count);
+
+/**
+ * Draws a video frame. When the compositor supports the format, the planes are
+ * copied into the buffer unchanged. Otherwise the frame is converted to XRGB
+ * with multiple threads. With wp_viewporter the compositor scales the frame to
+ * the window, otherwise its size has to match wwlGetDimensions(). Like the
+ * content of wwlDraw(), the planes have to stay valid until the next draw call.
+ * The raster functions and wwlAcquireBuffer() start over with the clear color,
+ * so overlays are better drawn into a layer
+ * @window: The window object
+ * @format: The format of the frame
+ * @width: The width of the frame in pixels. It has to be even
+ * @height: The height of the frame in pixels. It has to be even for NV12 and
+ * I420
+ * @planes: The planes of the frame. Unused planes can be NULL
+ * @strides: The number of bytes per row of each plane
+ */
+int wwlDrawYUV(wwlWindow* window, enum wwlYUVFormat format, int width, int height, const uint8_t* const planes[3], const int strides[3]);
+
+/**
+ * Returns true, when the compositor supports a video format directly, so
+ * wwlDrawYUV() doesn't have to convert the frames
+ * @window: The window object
+ * @format: The video format
+ */
+int wwlIsYUVFormatSupported(wwlWindow* window, enum wwlYUVFormat format);
+
+/**
+ * Fills the whole window with a color. The frame is shown with a single pixel,
+ * which the compositor scales to the size of the window, when it supports
+ * wp_viewporter. wwlDraw() does the same automatically for content, whose pixels
+ * all have the same value. The color is also used for the parts of the window,
+ * which the content doesn't cover
+ * @window: The window object
+ * @color: The color as ARGB8888 with premultiplied alpha. 0xFF000000 is opaque
+ * black
+ */
+void wwlClear(wwlWindow* window, uint32_t color);
+
+/**
+ * Gets a buffer, which isn't used by the compositor, to draw into directly.
+ * This avoids copying the content like wwlDraw() does. The buffer has the size
+ * of the window. Calling this function again before presenting returns the
+ * same buffer. Waits for the window to be configured the first time. The pixels
+ * stay valid until the buffer is presented, even when the window is resized
+ * meanwhile
+ * @window: The window object
+ * @pixels: A pointer, where the address of the pixels will be written. A Pixel
+ * has the format of wwlSetPixelFormat(), when the compositor supports it, and
+ * XRGB or ARGB otherwise
+ * @stride: A pointer, where the number of bytes per row will be written
+ *
+ * Returns the age of the buffer: 0, when the content is undefined, or the number
+ * of frames, which have been presented since the buffer has been presented.
+ * 1 means, that the buffer contains the last frame. Returns -1, when all buffers
+ * are busy
+ */
+int wwlAcquireBuffer(wwlWindow* window, uint32_t** pixels, int* stride);
+
+/**
+ * Shows the acquired buffer on screen and damages the whole window
+ * @window: The window object
+ */
+int wwlPresent(wwlWindow* window);
+
+/**
+ * Shows the acquired buffer on screen and damages only the given regions and the
+ * regions, which the raster functions have changed. The rest of the buffer has
+ * to be the same as in the last frame. With a count of 0 only the changes of the
+ * raster functions are shown
+ * @window: The window object
+ * @rects: The regions, which have changed
+ * @count: The number of regions
+ */
+int wwlPresentRegions(wwlWindow* window, const wwlRect* rects, int count);
+
+/**
+ * Fills a rectangle of the back buffer with a color and damages it. The back
+ * buffer is the acquired buffer or, when none has been acquired, a new buffer
+ * with the content of the last frame. The raster functions use SIMD instructions
+ * of the CPU, when they are available. Show the result with wwlPresentRegions()
+ * and a count of 0. Returns -1, when all buffers are busy
+ * @window: The window object
+ * @rect: The region, which gets clipped to the window
+ * @color: The color in the pixel format of the buffer
+ */
+int wwlFillRect(wwlWindow* window, const wwlRect* rect, uint32_t color);
+
+/**
+ * Copies an image into the back buffer and damages the region. Returns -1, when
+ * all buffers are busy
+ * @window: The window object
+ * @x: The x position in the window
+ * @y: The y position in the window
+ * @pixels: The image in the pixel format of the buffer
+ * @stride: The number of bytes per row of the image
+ * @width: The width of the image
+ * @height: The height of the image
+ */
+int wwlBlit(wwlWindow* window, int x, int y, const void* pixels, int stride, int width, int height);
+
+/**
+ * Blends an image with premultiplied alpha over the back buffer and damages the
+ * region. Only works with 32 bit formats, whose highest byte is the alpha, like
+ * XRGB8888 and ARGB8888. Returns -1, when all buffers are busy or the buffer has
+ * another format
+ * @window: The window object
+ * @x: The x position in the window
+ * @y: The y position in the window
+ * @pixels: The image in the pixel format of the buffer
+ * @stride: The number of bytes per row of the image
+ * @width: The width of the image
+ * @height: The height of the image
+ */
+int wwlBlendOver(wwlWindow* window, int x, int y, const uint32_t* pixels, int stride, int width, int height);
+
+/**
+ * Moves the content of a region of the back buffer by dx and dy and damages the
+ * moved pixels. Pixels, which leave the region, are discarded. The uncovered
+ * part of the region keeps its old content and has to be drawn again
+ * @window: The window object
+ * @rect: The region, which gets clipped to the window
+ * @dx: The horizontal movement in pixels
+ * @dy: The vertical movement in pixels
+ */
+int wwlScrollRegion(wwlWindow* window, const wwlRect* rect, int dx, int dy);
+
+/**
+ * Sets the pixel format of the content. When the compositor supports the
+ * format, the pixels are passed to it unchanged. Otherwise they are converted to
+ * XRGB8888 or ARGB8888, while they are copied. The buffers of
+ * wwlAcquireBuffer() always have a supported format. The default is
+ * WWL_FORMAT_XRGB8888
+ * @window: The window object
+ * @format: The format of the content
+ */
+int wwlSetPixelFormat(wwlWindow* window, enum wwlPixelFormat format);
+
+/**
+ * Returns true, when the compositor supports a pixel format directly
+ * @window: The window object
+ * @format: The pixel format
+ */
+int wwlIsFormatSupported(wwlWindow* window, enum wwlPixelFormat format);
+
+/**
+ * Sets the options for the shared memory of the buffers. They apply to the
+ * memory, which is allocated afterwards, so they should be set before the first
+ * frame. Each option is a hint: Without huge pages in the kernel, or when the
+ * memory lock limit is reached, the normal pages are used. The default is
+ * WWL_MEMORY_PREFAULT
+ * @window: The window object
+ * @flags: A bitmask of wwlMemoryFlags
+ */
+void wwlSetMemoryFlags(wwlWindow* window, uint32_t flags);
+
+/**
+ * Enables or disables the automatic damage detection. When enabled, wwlDraw()
+ * compares the content with the frame on screen in tiles of 64x64 pixels and
+ * only copies and damages the tiles, which have changed. Only works with 32 bit
+ * formats, which the compositor supports. Disabled by default
+ * @window: The window object
+ * @enabled: 1 to enable and 0 to disable the detection
+ */
+void wwlSetAutoDamage(wwlWindow* window, int enabled);
+
+/**
+ * Gets the cost and result of the last automatic damage detection
+ * @window: The window object
+ * @stats: A pointer, where the statistics will be written
+ */
+void wwlGetDiffStats(wwlWindow* window, wwlDiffStats* stats);
+
+/**
+ * Gets the presentation statistics of the window. They are only collected, when
+ * the compositor supports the presentation-time protocol
+ * @window: The window object
+ * @stats: A pointer, where the statistics will be written
+ */
+void wwlGetFrameStats(wwlWindow* window, wwlFrameStats* stats);
+
+/**
+ * Gets the counters of the window, which are always collected. Compare two
+ * snapshots to see, where the time of a slow frame went
+ * @window: The window object
+ * @stats: A pointer, where the counters will be written
+ */
+void wwlGetStats(wwlWindow* window, wwlStats* stats);
+
+/**
+ * Writes the work of the library, like handling events, uploading and committing
+ * frames, compiling the keymap and calling the callbacks, as spans in the Chrome
+ * trace format into a file, which can be opened with Perfetto or
+ * chrome://tracing. The spans of all windows of the process go into the same
+ * file. A path of NULL stops tracing and completes the file. Don't stop it, while
+ * another thread uses a window. Returns -1, when the file can't be opened. When
+ * the library is built with -DWWL_USDT, the spans are also USDT probes wwl:begin
+ * and wwl:end
+ * @path: The path of the trace file or NULL
+ */
+int wwlSetTraceFile(const char* path);
+
 /**
  * Sets the title of the window
  * @window: The window object
@@ -92,6 +609,141 @@ enum wwlKeyAction {
  */
 void wwlSetKeyCallback(wwlWindow* window, void (*key_callback)(wwlWindow* window, char* key, enum wwlKeyAction action));
 
+/**
+ * Modifiers, which are passed to the keysym callback as a bitmask
+ */
+enum wwlModifier {
+    WWL_MOD_SHIFT = 1 << 0,
+    WWL_MOD_CTRL = 1 << 1,
+    WWL_MOD_ALT = 1 << 2,
+    WWL_MOD_SUPER = 1 << 3,
+    WWL_MOD_CAPS_LOCK = 1 << 4,
+    WWL_MOD_NUM_LOCK = 1 << 5
+};
+
+/**
+ * Sets the callback for when a key is pressed or released. Unlike the callback
+ * of wwlSetKeyCallback(), it doesn't format the name of the key. Both callbacks
+ * can be set at the same time
+ * @window: The window object
+ * @keysym_callback: The callback function, which takes the window object, the xkb keycode, the modifier sensitive keysym (one of the XKB_KEY_* values of xkbcommon-keysyms.h), the bitmask of the active wwlModifiers, the timestamp in milliseconds (0 for keys, which were held when the window got the focus) and the action
+ */
+void wwlSetKeySymCallback(wwlWindow* window, void (*keysym_callback)(wwlWindow* window, uint32_t keycode, uint32_t keysym, uint32_t modifiers, uint32_t time, enum wwlKeyAction action));
+
+/**
+ * Returns true, when the key is held down in the window. Keys are identified by
+ * their unshifted keysym, letters can be queried in upper or lower case. Only
+ * the Latin-1 keysyms and the function keys (XKB_KEY_BackSpace to
+ * XKB_KEY_Delete, like the arrows, the keypad, F1 to F35 and the modifiers) are
+ * tracked. All keys are released, when the window loses the keyboard focus
+ * @window: The window object
+ * @keysym: The keysym
+ */
+int wwlIsKeyDown(wwlWindow* window, uint32_t keysym);
+
+/**
+ * Types of the input events in the event queue
+ */
+enum wwlEventType {
+    WWL_EVENT_KEY,
+    WWL_EVENT_MOTION,
+    WWL_EVENT_BUTTON,
+    WWL_EVENT_SCROLL,
+    WWL_EVENT_RELATIVE_MOTION
+};
+
+/**
+ * Events of the event queue, which are merged, when they follow each other
+ */
+enum wwlCoalesce {
+    /* Only the newest cursor position is kept */
+    WWL_COALESCE_MOTION = 1 << 0,
+    /* The scroll offsets are summed up */
+    WWL_COALESCE_SCROLL = 1 << 1,
+    /* The relative motions are summed up */
+    WWL_COALESCE_RELATIVE = 1 << 2
+};
+
+typedef struct wwlEvent {
+    enum wwlEventType type;
+    /* The timestamp of the event in milliseconds. 0, when unknown */
+    uint32_t time;
+    /* The timestamp of the event in nanoseconds of CLOCK_MONOTONIC. It has the
+    full resolution, when the compositor supports zwp_input_timestamps_v1, and
+    has the resolution of time otherwise. 0, when unknown */
+    uint64_t timestamp;
+    union {
+        /* WWL_EVENT_KEY. The same values as in the keysym callback */
+        struct {
+            uint32_t keycode;
+            uint32_t keysym;
+            uint32_t modifiers;
+            enum wwlKeyAction action;
+        } key;
+        /* WWL_EVENT_MOTION. The new position of the cursor */
+        struct {
+            double x;
+            double y;
+        } motion;
+        /* WWL_EVENT_BUTTON */
+        struct {
+            int button;
+            enum wwlKeyAction action;
+        } button;
+        /* WWL_EVENT_SCROLL. Unlike the scroll callback, which passes the vertical
+        offset first, x_offset is the horizontal and y_offset the vertical
+        offset */
+        struct {
+            double x_offset;
+            double y_offset;
+        } scroll;
+        /* WWL_EVENT_RELATIVE_MOTION. The same values as in the relative motion
+        callback */
+        struct {
+            double dx;
+            double dy;
+            double dx_unaccel;
+            double dy_unaccel;
+        } relative;
+    };
+} wwlEvent;
+
+typedef struct wwlEventStats {
+    /* The number of events, which have been added to the queue */
+    uint64_t queued;
+    /* The number of events, which have been lost, because the queue was full */
+    uint64_t dropped;
+    /* The number of events, which have been merged into the previous event */
+    uint64_t coalesced;
+} wwlEventStats;
+
+/**
+ * Collects the input events of the window in a ring buffer instead of calling
+ * the key, cursor, button and scroll callbacks. The events are taken from it
+ * with wwlDrainEvents(), usually once per frame. A capacity of 0 removes the
+ * queue and restores the callbacks. Returns -1 on error
+ * @window: The window object
+ * @capacity: The maximum number of events in the queue
+ * @coalesce: Bitmask of the wwlCoalesce event types, which are merged
+ */
+int wwlSetEventQueue(wwlWindow* window, int capacity, int coalesce);
+
+/**
+ * Takes at most max events in order from the event queue and returns their
+ * number. Has to be called from the thread, which handles the events
+ * @window: The window object
+ * @events: The array, which receives the events
+ * @max: The size of the array
+ */
+int wwlDrainEvents(wwlWindow* window, wwlEvent* events, int max);
+
+/**
+ * Gets the counters of the event queue
+ * @window: The window object
+ * @stats: The counters
+ */
+void wwlGetEventStats(wwlWindow* window, wwlEventStats* stats);
+
 /**
  * Gets the current position of the cursor in the window
  * @window: The window object
@@ -122,9 +774,205 @@ void wwlSetMouseButtonCallback(wwlWindow* window, void (*button_callback)(wwlWin
 void wwlSetScrollCallback(wwlWindow* window, void (*scroll_callback)(wwlWindow* window, double x_offset, double y_offset));
 
 /**
- * Closes the window
+ * Sets the callback for the relative motion of the pointer. Unlike the cursor
+ * position it isn't limited by the edges of the window, and the unaccelerated
+ * deltas are the raw movement of the device. Needs zwp_relative_pointer_v1,
+ * otherwise the callback is never called
+ * @window: The window object
+ * @relative_callback: The callback function, which takes the window object,
+ * the accelerated deltas and the unaccelerated deltas in surface coordinates
+ */
+void wwlSetRelativeMotionCallback(wwlWindow* window, void (*relative_callback)(wwlWindow* window, double dx, double dy, double dx_unaccel, double dy_unaccel));
+
+/**
+ * Returns the timestamp of the input event, whose callback is running, in
+ * nanoseconds of CLOCK_MONOTONIC. See the timestamp of wwlEvent. 0, when unknown
+ * @window: The window object
+ */
+uint64_t wwlGetEventTime(wwlWindow* window);
+
+typedef struct wwlInputLatency {
+    /* The number of traced input events, whose frame has been committed */
+    uint64_t committed;
+    /* The number of traced input events, whose frame has been shown on screen */
+    uint64_t presented;
+    /* The time from the last traced event to the commit of the first frame after
+    it in nanoseconds */
+    uint64_t to_commit;
+    /* The time from the last traced event to the presentation of that frame in
+    nanoseconds */
+    uint64_t to_present;
+    /* The highest value of to_present */
+    uint64_t max_to_present;
+    /* The sums of to_commit and to_present, which give the averages */
+    uint64_t total_to_commit;
+    uint64_t total_to_present;
+} wwlInputLatency;
+
+/**
+ * Enables or disables the input tracer. It links the oldest input event since
+ * the last commit to the next commit and to the presentation of that frame, or
+ * of the frame, which replaces it. The presentation needs wp_presentation. With
+ * a trace file from wwlSetTraceFile() the tracer also writes the spans
+ * input-to-commit and commit-to-present for every traced event
+ * @window: The window object
+ * @enabled: True to trace the input events
+ */
+void wwlSetInputTracing(wwlWindow* window, int enabled);
+
+/**
+ * Gets the latencies of the input tracer
+ * @window: The window object
+ * @latency: The latencies
+ */
+void wwlGetInputLatency(wwlWindow* window, wwlInputLatency* latency);
+
+/**
+ * Sets the callback for when the compositor is ready for the next frame. Draw
+ * the next frame inside of the callback to present exactly one frame per
+ * refresh of the display. The callback only gets called again after a frame has
+ * been presented or wwlRequestFrame() has been called. The compositor doesn't
+ * call it, while the window isn't visible
+ * @window: The window object
+ * @frame_callback: The callback function, which takes the window object and the
+ * time of the frame in milliseconds
+ */
+void wwlSetFrameCallback(wwlWindow* window, void (*frame_callback)(wwlWindow* window, uint32_t time));
+
+/**
+ * Requests a call of the frame callback without presenting a new frame
+ * @window: The window object
+ */
+void wwlRequestFrame(wwlWindow* window);
+
+/**
+ * Begins a transaction. Until wwlEndFrame() nothing is committed or sent to the
+ * compositor, so the frame, the title, the regions and the changes of the layers
+ * appear together. Returns -1, when a transaction has already begun or the
+ * window is a layer
+ * @window: The window object
+ */
+int wwlBeginFrame(wwlWindow* window);
+
+/**
+ * Ends the transaction. The layers and the window are committed once, with the
+ * frames of all layers held back until the window is committed, and the
+ * requests are sent with a single flush. A damaged window is presented, unless
+ * the compositor hasn't finished the last frame yet. Then it is presented with
+ * the next frame callback. Returns -1 on error
+ * @window: The window object
+ */
+int wwlEndFrame(wwlWindow* window);
+
+/**
+ * Sets the region of the window or the layer, which is fully opaque, so the
+ * compositor can skip drawing, what is behind it. The region is applied with the
+ * next frame or, if there is none, when the events are handled the next time
+ * @window: The window object or the layer
+ * @rects: The opaque rectangles in surface coordinates. NULL for no opaque region
+ * @count: The number of rectangles
+ */
+void wwlSetOpaqueRegion(wwlWindow* window, const wwlRect* rects, int count);
+
+/**
+ * Sets the region of the window or the layer, which receives pointer and touch
+ * input. The region is applied like the opaque region
+ * @window: The window object or the layer
+ * @rects: The rectangles in surface coordinates. NULL for the whole surface
+ * @count: The number of rectangles
+ */
+void wwlSetInputRegion(wwlWindow* window, const wwlRect* rects, int count);
+
+/**
+ * Creates a layer on top of the window. A layer is a separate surface with its
+ * own buffers, which the compositor blends over the window, so only the layers,
+ * which change, get copied and committed. All functions, which draw, present
+ * or set the frame callback, also work with a layer in place of the window.
+ * Layers update independently of their window by default and don't receive
+ * input. Returns NULL, when the compositor doesn't support wl_subcompositor or
+ * the window has a render thread
+ * @window: The window object
+ * @x: The x position of the layer in the window
+ * @y: The y position of the layer in the window
+ * @width: The width of the layer
+ * @height: The height of the layer
+ */
+wwlLayer* wwlCreateLayer(wwlWindow* window, int x, int y, int width, int height);
+
+/**
+ * Moves the layer. The new position is applied with the next frame of the window
+ * or, if it has none, when the events are handled the next time
+ * @layer: The layer
+ * @x: The x position of the layer in the window
+ * @y: The y position of the layer in the window
+ */
+void wwlSetLayerPosition(wwlLayer* layer, int x, int y);
+
+/**
+ * Places the layer directly above a sibling, which is another layer of the same
+ * window or the window itself. Applied like the position
+ * @layer: The layer
+ * @sibling: The sibling
+ */
+void wwlPlaceLayerAbove(wwlLayer* layer, wwlWindow* sibling);
+
+/**
+ * Places the layer directly below a sibling, which is another layer of the same
+ * window or the window itself. Layers below the window are hidden by opaque
+ * content of the window
+ * @layer: The layer
+ * @sibling: The sibling
+ */
+void wwlPlaceLayerBelow(wwlLayer* layer, wwlWindow* sibling);
+
+/**
+ * Enables or disables the synchronized mode of the layer. In synchronized mode
+ * the frames of the layer are only shown together with the next commit of the
+ * window, so they can change atomically. Disabled by default
+ * @layer: The layer
+ * @sync: 1 to enable and 0 to disable the synchronized mode
+ */
+void wwlSetLayerSync(wwlLayer* layer, int sync);
+
+/**
+ * Removes the layer from its window. wwlCloseWindow() removes all layers of the
+ * window
+ * @layer: The layer
+ */
+void wwlDestroyLayer(wwlLayer* layer);
+
+/**
+ * Moves the presentation of the window to a separate render thread. Frame
+ * callbacks, buffer releases and presentation feedback are then handled in a
+ * private event queue by the render thread, while input and window events are
+ * handled by the thread, which calls wwlShouldClose() or wwlPollEvents(). After
+ * this call, wwlDraw(), wwlDrawRegion(), wwlAcquireBuffer(), wwlPresent(),
+ * wwlGetDimensions() and wwlWaitFrame() may only be called from the render
+ * thread. Has to be called before the first events are handled. Returns -1 on
+ * error
+ * @window: The window object
+ */
+int wwlSetRenderThread(wwlWindow* window);
+
+/**
+ * Presents the pending frame and waits until the compositor is ready for the
+ * next one. Only used in render thread mode. Returns -1, when the window has
+ * been closed or the connection has been lost
+ * @window: The window object
+ */
+int wwlWaitFrame(wwlWindow* window);
+
+/**
+ * Closes the window. A window created with wwlCreateWindow() also closes its
+ * connection
  * @window: The window object
  */
 void wwlCloseWindow(wwlWindow* window);
 
+/**
+ * Closes all windows of the context and the connection to the compositor
+ * @context: The context
+ */
+void wwlDestroyContext(wwlContext* context);
+
 #endif /* WWL_H */
\ No newline at end of file